@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: Apache-2.0
+#
+# Run a number of nodes of the benchmark build under BabbleSim, and report
+# the delivery ratio and latency of the OnOff Set messages they send.
+#
+# Build the application for the nrf52_bsim board with overlay-bench.conf
+# first, for instance:
+#
+#   west build -b nrf52_bsim -- -DEXTRA_CONF_FILE=overlay-bench.conf
+#
+# Usage: bench.sh <zephyr.exe> <nodes> [simulated seconds]
+#
+# Set LPN_EXE to a build with both overlay-bench.conf and overlay-lpn.conf,
+# and LPN_NODES to a number of nodes, to run that many of the nodes as Low
+# Power Nodes and report their energy estimates. Rebuild it with another
+# CONFIG_BT_MESH_LPN_POLL_TIMEOUT to compare poll intervals.
+
+set -eu
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 <zephyr.exe> <nodes> [simulated seconds]" >&2
+	exit 1
+fi
+
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH must point to the BabbleSim build}"
+
+exe=$(realpath "$1")
+nodes=$2
+lpn_nodes=${LPN_NODES:-0}
+lpn_exe=${LPN_EXE:+$(realpath "$LPN_EXE")}
+seconds=${3:-90}
+sim_id=mesh_bench_$$
+out_dir=$(mktemp -d)
+
+if [ "$nodes" -lt 2 ] || [ "$nodes" -gt 200 ]; then
+	echo "The number of nodes must be between 2 and 200" >&2
+	exit 1
+fi
+
+if [ "$lpn_nodes" -gt 0 ] && { [ -z "$lpn_exe" ] || [ "$lpn_nodes" -ge "$nodes" ]; }; then
+	echo "LPN_NODES needs LPN_EXE, and at least one Friend node" >&2
+	exit 1
+fi
+
+cd "${BSIM_OUT_PATH}/bin"
+
+for ((i = 0; i < nodes; i++)); do
+	node_exe=$exe
+	if [ "$i" -ge "$((nodes - lpn_nodes))" ]; then
+		node_exe=$lpn_exe
+	fi
+
+	"$node_exe" -s="$sim_id" -d="$i" -RealEncryption=1 -rs="$((i + 1))" \
+		> "${out_dir}/node_${i}.log" 2>&1 &
+done
+
+./bs_2G4_phy_v1 -s="$sim_id" -D="$nodes" -sim_length="$((seconds * 1000000))" \
+	> "${out_dir}/phy.log" 2>&1
+
+wait
+
+python3 "$(dirname "$(realpath "$0")")/bench_report.py" "${out_dir}"/node_*.log
+
+echo "Logs are in ${out_dir}"
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Compute delivery ratio and latency from the logs of a benchmark run.
+
+Every node prints "bench tx <usec>" when it presses its button, and logs the
+OnOff Set messages it receives with their timestamp, source and TTL. All
+nodes of a BabbleSim run share the same simulated time, so a received
+message is matched to the latest press of its source node.
+
+Low Power Nodes also print "lpn energy" lines, the last of which is reported
+for each of them.
+"""
+
+import argparse
+import bisect
+import re
+import sys
+
+ADDR_RE = re.compile(r"Self-provisioning with address 0x([0-9a-fA-F]+)")
+TX_RE = re.compile(r"^bench tx (\d+)")
+RX_RE = re.compile(r"^\[(\d+)\.(\d+)\] op 0x([0-9a-f]+) from 0x([0-9a-f]+) "
+                   r"ttl (\d+):")
+LPN_RE = re.compile(r"^lpn energy polls (\d+) tx (\d+) ms rx (\d+) ms "
+                    r"avg (\d+) uA")
+
+# OnOff Set, OnOff Set Unacknowledged and the vendor Batched Set
+SET_OPCODES = {0x8202, 0x8203, 0xc105f1}
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+
+def parse(path):
+    addr = None
+    tx = []
+    rx = []
+    energy = None
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = ADDR_RE.search(line)
+            if m:
+                addr = int(m.group(1), 16)
+                continue
+
+            m = TX_RE.match(line)
+            if m:
+                tx.append(int(m.group(1)))
+                continue
+
+            m = LPN_RE.match(line)
+            if m:
+                energy = tuple(int(g) for g in m.groups())
+                continue
+
+            m = RX_RE.match(line)
+            if m and int(m.group(3), 16) in SET_OPCODES:
+                t = int(m.group(1)) * 1000000 + int(m.group(2))
+                rx.append((t, int(m.group(4), 16), int(m.group(5))))
+
+    return addr, tx, rx, energy
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--ttl", type=int, default=7,
+                        help="TTL the messages are sent with")
+    parser.add_argument("logs", nargs="+", help="Node logs")
+    args = parser.parse_args()
+
+    nodes = [parse(path) for path in args.logs]
+    presses = {addr: sorted(tx) for addr, tx, _, _ in nodes
+               if addr is not None}
+
+    # First reception of each press on each receiving node
+    first = {}
+    for receiver, (_, _, rx, _) in enumerate(nodes):
+        for t, src, ttl in rx:
+            tx = presses.get(src, [])
+            i = bisect.bisect_right(tx, t) - 1
+            if i < 0:
+                continue
+
+            key = (receiver, src, i)
+            if key not in first or t - tx[i] < first[key][0]:
+                first[key] = (t - tx[i], args.ttl - ttl)
+
+    expected = sum(len(tx) for tx in presses.values()) * (len(nodes) - 1)
+    if not expected or not first:
+        print("No presses or receptions found", file=sys.stderr)
+        return 1
+
+    latencies = [lat for lat, _ in first.values()]
+
+    print(f"nodes:          {len(nodes)}")
+    print(f"presses:        {sum(len(tx) for tx in presses.values())}")
+    print(f"delivery ratio: {len(first) / expected:.3f}")
+    print(f"latency p50:    {percentile(latencies, 50) / 1000:.1f} ms")
+    print(f"latency p99:    {percentile(latencies, 99) / 1000:.1f} ms")
+    print()
+    print("relays  received  p50 (ms)  p99 (ms)")
+
+    for hops in sorted({h for _, h in first.values()}):
+        lat = [l for l, h in first.values() if h == hops]
+        print(f"{hops:6}  {len(lat):8}  {percentile(lat, 50) / 1000:8.1f}  "
+              f"{percentile(lat, 99) / 1000:8.1f}")
+
+    lpns = [(addr, energy) for addr, _, _, energy in nodes if energy]
+    if lpns:
+        print()
+        print("lpn     polls  tx (ms)  rx (ms)  avg (uA)")
+
+        for addr, (polls, tx_ms, rx_ms, avg_ua) in lpns:
+            print(f"0x{addr or 0:04x}  {polls:5}  {tx_ms:7}  {rx_ms:7}  "
+                  f"{avg_ua:8}")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
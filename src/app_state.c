@@ -0,0 +1,149 @@
+/* app_state.c - Persistent application state */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+
+#include "app_state.h"
+#include "model_stats.h"
+
+#define APP_STATE_SETTINGS_KEY "app/state"
+
+struct app_state_entry {
+	const char *name;
+	/* Number of bytes stored */
+	uint8_t len;
+	uint32_t value;
+	/* Value in persistent storage */
+	uint32_t stored;
+};
+
+static struct app_state_entry entries[APP_STATE_COUNT] = {
+	[APP_STATE_ONOFF]            = { "onoff", 1, 0, 0 },
+	[APP_STATE_LIGHTNESS]        = { "lightness", 2, 0, 0 },
+	[APP_STATE_LIGHTNESS_LAST]   = { "last", 2, UINT16_MAX, UINT16_MAX },
+	[APP_STATE_SCENE]            = { "scene", 2, 0, 0 },
+	[APP_STATE_PRESSES]          = { "presses", 4, 0, 0 },
+	[APP_STATE_RELAY_SUPPRESSED] = { "relay_off", 1, 0, 0 },
+	[APP_STATE_RELAY_XMIT]       = { "relay_xmit", 2, 0, 0 },
+	[APP_STATE_PROBE_ADDR]       = { "probe", 2, 0, 0 },
+};
+
+static struct k_spinlock lock;
+
+static void app_state_save(struct k_work *work)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+		struct app_state_entry *entry = &entries[i];
+		char key[sizeof(APP_STATE_SETTINGS_KEY "/") + 16];
+		k_spinlock_key_t lock_key;
+		uint8_t data[sizeof(uint32_t)];
+		uint32_t value;
+		int err;
+
+		lock_key = k_spin_lock(&lock);
+		value = entry->value;
+		k_spin_unlock(&lock, lock_key);
+
+		/* Changes that were reverted within the window cost nothing */
+		if (value == entry->stored) {
+			continue;
+		}
+
+		sys_put_le32(value, data);
+		snprintk(key, sizeof(key), APP_STATE_SETTINGS_KEY "/%s",
+			 entry->name);
+
+		err = settings_save_one(key, data, entry->len);
+		if (err) {
+			atomic_inc(&flash_stats.failed);
+			printk("Storing %s failed (err %d)\n", key, err);
+			continue;
+		}
+
+		entry->stored = value;
+		atomic_inc(&flash_stats.writes);
+		atomic_add(&flash_stats.bytes, entry->len);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(save_work, app_state_save);
+
+uint32_t app_state_get(enum app_state_id id)
+{
+	return entries[id].value;
+}
+
+void app_state_set(enum app_state_id id, uint32_t value)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool changed = entries[id].value != value;
+
+	entries[id].value = value;
+
+	k_spin_unlock(&lock, key);
+
+	if (!changed || !IS_ENABLED(CONFIG_SETTINGS)) {
+		return;
+	}
+
+	atomic_inc(&flash_stats.changes);
+
+	/* Flash writes go through the system work queue, and don't hold up
+	 * the application work queue. Scheduling doesn't restart a pending
+	 * window, so a stream of changes is still written regularly.
+	 */
+	k_work_schedule(&save_work, K_MSEC(CONFIG_APP_STATE_SAVE_DELAY_MS));
+}
+
+void app_state_flush(void)
+{
+	if (!IS_ENABLED(CONFIG_SETTINGS)) {
+		return;
+	}
+
+	k_work_cancel_delayable(&save_work);
+	app_state_save(NULL);
+}
+
+static __maybe_unused int app_state_settings_set(const char *name, size_t len,
+						 settings_read_cb read_cb,
+						 void *cb_arg)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+		struct app_state_entry *entry = &entries[i];
+		uint8_t data[sizeof(uint32_t)] = { 0 };
+		const char *next;
+		ssize_t read;
+
+		if (!settings_name_steq(name, entry->name, &next) || next) {
+			continue;
+		}
+
+		if (len != entry->len) {
+			return -EINVAL;
+		}
+
+		read = read_cb(cb_arg, data, len);
+		if (read < 0) {
+			return read;
+		}
+
+		entry->value = sys_get_le32(data);
+		entry->stored = entry->value;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+#if defined(CONFIG_SETTINGS)
+SETTINGS_STATIC_HANDLER_DEFINE(app_state, APP_STATE_SETTINGS_KEY, NULL,
+			       app_state_settings_set, NULL, NULL);
+#endif
@@ -0,0 +1,63 @@
+/* app_state.h - Persistent application state */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_STATE_H__
+#define APP_STATE_H__
+
+#include <zephyr/kernel.h>
+
+enum app_state_id {
+	/** State last sent by the Generic OnOff Client */
+	APP_STATE_ONOFF,
+	/** Light Lightness Actual, which the Generic Level follows */
+	APP_STATE_LIGHTNESS,
+	/** Last non-zero lightness, restored when switched on */
+	APP_STATE_LIGHTNESS_LAST,
+	/** Current scene, 0 if none */
+	APP_STATE_SCENE,
+	/** Number of accepted button presses since the first boot */
+	APP_STATE_PRESSES,
+	/** Relaying was disabled by the adaptive relay policy */
+	APP_STATE_RELAY_SUPPRESSED,
+	/** Relay retransmit parameters configured for the node, with bit 8
+	 *  set while the adaptive relay policy has lowered them, 0 otherwise
+	 */
+	APP_STATE_RELAY_XMIT,
+	/** Temporary address of an unfinished address probe, 0 if none */
+	APP_STATE_PROBE_ADDR,
+
+	APP_STATE_COUNT,
+};
+
+/** Get a state value.
+ *
+ *  Returns the value restored from settings, or its default if it has never
+ *  been stored, until the value is changed with app_state_set().
+ *
+ *  @param id State to get.
+ */
+uint32_t app_state_get(enum app_state_id id);
+
+/** Change a state value.
+ *
+ *  Changes aren't written right away. The first change starts a
+ *  CONFIG_APP_STATE_SAVE_DELAY_MS window, at the end of which only the
+ *  values that differ from the stored ones are written. Safe to call from
+ *  any context.
+ *
+ *  @param id    State to change.
+ *  @param value New value.
+ */
+void app_state_set(enum app_state_id id, uint32_t value);
+
+/** Write the pending state changes right away.
+ *
+ *  For changes that must reach persistent storage before anything else
+ *  does. Must not be called from the Bluetooth RX thread.
+ */
+void app_state_flush(void);
+
+#endif /* APP_STATE_H__ */
@@ -0,0 +1,56 @@
+/* bench.c - Synthetic button presses for benchmarking */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/random/random.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "bench.h"
+
+static struct k_work_q *press_queue;
+static struct k_work *press_work;
+static struct k_work_delayable bench_work;
+static uint32_t presses;
+
+static k_timeout_t bench_delay(void)
+{
+	return K_MSEC(CONFIG_APP_BENCH_INTERVAL_MS +
+		      sys_rand32_get() % (CONFIG_APP_BENCH_JITTER_MS + 1));
+}
+
+static void bench_press(struct k_work *work)
+{
+	if (!bt_mesh_is_provisioned()) {
+		k_work_schedule(&bench_work, bench_delay());
+		return;
+	}
+
+	if (presses == CONFIG_APP_BENCH_PRESSES) {
+		printk("bench done\n");
+		return;
+	}
+
+	presses++;
+
+	printk("bench tx %u\n", k_ticks_to_us_floor32(k_uptime_ticks()));
+	k_work_submit_to_queue(press_queue, press_work);
+
+	k_work_schedule(&bench_work, bench_delay());
+}
+
+void bench_start(struct k_work_q *queue, struct k_work *press)
+{
+	/* Give all nodes time to join before the first press */
+	uint32_t delay_ms = CONFIG_APP_BENCH_START_DELAY_MS +
+			    sys_rand32_get() % CONFIG_APP_BENCH_INTERVAL_MS;
+
+	press_queue = queue;
+	press_work = press;
+
+	k_work_init_delayable(&bench_work, bench_press);
+	k_work_schedule(&bench_work, K_MSEC(delay_ms));
+}
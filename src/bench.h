@@ -0,0 +1,25 @@
+/* bench.h - Synthetic button presses for benchmarking */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include <zephyr/kernel.h>
+
+/** Start pressing the button.
+ *
+ *  Once the node is provisioned, @p press is submitted to @p queue every
+ *  CONFIG_APP_BENCH_INTERVAL_MS plus a random jitter, for a total of
+ *  CONFIG_APP_BENCH_PRESSES presses. The time of every press is printed as
+ *  "bench tx <usec>", so it can be matched against the received message log
+ *  of the other nodes.
+ *
+ *  @param queue Work queue that handles button presses.
+ *  @param press Work item that handles a button press.
+ */
+void bench_start(struct k_work_q *queue, struct k_work *press);
+
+#endif /* BENCH_H__ */
@@ -0,0 +1,135 @@
+/* dup_density.c - Duplicate density of the network PDUs heard over the air */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+#include "dup_density.h"
+#include "model_stats.h"
+
+#define SETS CONFIG_APP_DUP_DENSITY_SETS
+#define WAYS CONFIG_APP_DUP_DENSITY_WAYS
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SETS), "Set count must be a power of two");
+
+/* A relay re-encrypts the PDUs it forwards with a lower TTL, so only copies
+ * of a message sent at the same hop, such as the retransmissions of a node
+ * and the copies relayed by its neighbours, are identical. Counting those
+ * estimates the density of the neighbourhood. The stack's message cache is
+ * keyed on the source and sequence number, which the application can't see
+ * without the network keys, and holds one entry for all hops, so none of
+ * these counts tell how it should be sized.
+ *
+ * Each set is kept in most recently used order. Hash value 0 marks a free
+ * entry.
+ */
+static uint32_t sets[SETS][WAYS];
+
+/* Hashes evicted most recently from each set, oldest first replaced, to
+ * count the duplicates heard after their entry was replaced
+ */
+static uint32_t evicted[SETS][WAYS];
+static uint8_t evicted_next[SETS];
+
+static uint32_t pdu_hash(const uint8_t *pdu, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ pdu[i]) * 16777619u;
+	}
+
+	return hash ? hash : 1;
+}
+
+static void evicted_put(size_t set, uint32_t hash)
+{
+	evicted[set][evicted_next[set]] = hash;
+	evicted_next[set] = (evicted_next[set] + 1) % WAYS;
+}
+
+/** Only the set the hash maps to can have evicted it, so a lookup costs
+ *  as much as one in the table itself.
+ */
+static bool evicted_has(size_t set, uint32_t hash)
+{
+	for (size_t way = 0; way < WAYS; way++) {
+		if (evicted[set][way] == hash) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/** Look up a PDU and make it the most recently used entry of its set. */
+static void dup_density_sample(uint32_t hash)
+{
+	/* Use the top bits for the set, the FNV-1a low bits mix poorly */
+	size_t idx = (hash >> 16) & (SETS - 1);
+	uint32_t *set = sets[idx];
+	size_t way;
+
+	atomic_inc(&density_stats.pdus);
+
+	for (way = 0; way < WAYS - 1; way++) {
+		if (set[way] == hash || !set[way]) {
+			break;
+		}
+	}
+
+	if (set[way] == hash) {
+		atomic_inc(&density_stats.dups);
+	} else {
+		if (evicted_has(idx, hash)) {
+			atomic_inc(&density_stats.missed);
+		}
+
+		/* Either a free entry, or the least recently used one */
+		if (set[way]) {
+			atomic_inc(&density_stats.evictions);
+			evicted_put(idx, set[way]);
+		}
+	}
+
+	memmove(&set[1], &set[0], way * sizeof(set[0]));
+	set[0] = hash;
+}
+
+static void scan_recv(const struct bt_le_scan_recv_info *info,
+		      struct net_buf_simple *buf)
+{
+	if (info->adv_type != BT_GAP_ADV_TYPE_ADV_NONCONN_IND) {
+		return;
+	}
+
+	while (buf->len > 1) {
+		uint8_t len = net_buf_simple_pull_u8(buf);
+		uint8_t type;
+
+		if (!len || len > buf->len) {
+			return;
+		}
+
+		type = net_buf_simple_pull_u8(buf);
+		if (type == BT_DATA_MESH_MESSAGE) {
+			dup_density_sample(pdu_hash(buf->data, len - 1));
+			return;
+		}
+
+		net_buf_simple_pull(buf, len - 1);
+	}
+}
+
+static struct bt_le_scan_cb scan_cb = {
+	.recv = scan_recv,
+};
+
+void dup_density_init(void)
+{
+	bt_le_scan_cb_register(&scan_cb);
+}
@@ -0,0 +1,24 @@
+/* dup_density.h - Duplicate density of the network PDUs heard over the air */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DUP_DENSITY_H__
+#define DUP_DENSITY_H__
+
+#include <zephyr/kernel.h>
+
+/** Start sampling the mesh network PDUs heard by the scanner.
+ *
+ *  The PDUs heard recently are remembered in a set associative table of
+ *  CONFIG_APP_DUP_DENSITY_SETS sets of CONFIG_APP_DUP_DENSITY_WAYS entries,
+ *  with least recently used replacement within a set, and every PDU found
+ *  in it is counted as a duplicate in density_stats. PDUs are compared as
+ *  heard, so only copies of a message sent at the same hop are duplicates.
+ *  This estimates the density of the neighbourhood. It says nothing about
+ *  the stack's message cache.
+ */
+void dup_density_init(void);
+
+#endif /* DUP_DENSITY_H__ */
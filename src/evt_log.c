@@ -0,0 +1,162 @@
+/* evt_log.c - Deferred log of received mesh messages */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdarg.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/shell/shell.h>
+
+#include "evt_log.h"
+
+#define EVT_LOG_SIZE CONFIG_APP_EVT_LOG_SIZE
+#define EVT_LOG_MASK (EVT_LOG_SIZE - 1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(EVT_LOG_SIZE),
+	     "The event log size must be a power of two");
+
+struct evt {
+	uint32_t timestamp;
+	uint32_t opcode;
+	uint16_t src;
+	uint8_t ttl;
+	uint8_t state;
+};
+
+/* Single producer, single consumer ring. The producer only writes head and
+ * the consumer only writes tail, so no lock is needed on either side.
+ */
+static struct evt ring[EVT_LOG_SIZE];
+static atomic_t head;
+static atomic_t tail;
+static atomic_t dropped;
+
+static K_SEM_DEFINE(evt_sem, 0, 1);
+
+/* Events already printed by the consumer, kept for the shell */
+static struct evt history[EVT_LOG_SIZE];
+static uint32_t history_cnt;
+static K_MUTEX_DEFINE(history_lock);
+
+void evt_log_put(uint32_t opcode, uint16_t src, uint8_t ttl, uint8_t state)
+{
+	atomic_val_t h = atomic_get(&head);
+	struct evt *evt;
+
+	if (h - atomic_get(&tail) >= EVT_LOG_SIZE) {
+		atomic_inc(&dropped);
+		return;
+	}
+
+	evt = &ring[h & EVT_LOG_MASK];
+	evt->timestamp = k_ticks_to_us_floor32(k_uptime_ticks());
+	evt->opcode = opcode;
+	evt->src = src;
+	evt->ttl = ttl;
+	evt->state = state;
+
+	/* Publish the event only after it has been written */
+	atomic_set(&head, h + 1);
+
+	k_sem_give(&evt_sem);
+}
+
+static void evt_print(const struct evt *evt,
+		      void (*print)(const char *fmt, ...))
+{
+	static const char *const state_str[] = { "off", "on" };
+
+	uint32_t sec = evt->timestamp / USEC_PER_SEC;
+	uint32_t usec = evt->timestamp % USEC_PER_SEC;
+
+	if (evt->state < ARRAY_SIZE(state_str)) {
+		print("[%u.%06u] op 0x%06x from 0x%04x ttl %u: %s\n", sec, usec,
+		      evt->opcode, evt->src, evt->ttl, state_str[evt->state]);
+	} else {
+		print("[%u.%06u] op 0x%06x from 0x%04x ttl %u: 0x%02x\n", sec,
+		      usec, evt->opcode, evt->src, evt->ttl, evt->state);
+	}
+}
+
+static void evt_printk(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintk(fmt, ap);
+	va_end(ap);
+}
+
+static void evt_log_drain(void *p1, void *p2, void *p3)
+{
+	while (1) {
+		atomic_val_t t = atomic_get(&tail);
+		struct evt evt;
+
+		if (t == atomic_get(&head)) {
+			k_sem_take(&evt_sem, K_FOREVER);
+			continue;
+		}
+
+		evt = ring[t & EVT_LOG_MASK];
+		atomic_set(&tail, t + 1);
+
+		k_mutex_lock(&history_lock, K_FOREVER);
+		history[history_cnt++ & EVT_LOG_MASK] = evt;
+		k_mutex_unlock(&history_lock);
+
+		if (IS_ENABLED(CONFIG_APP_EVT_LOG_PRINT)) {
+			evt_print(&evt, evt_printk);
+		}
+	}
+}
+
+K_THREAD_DEFINE(evt_log_thread, CONFIG_APP_EVT_LOG_STACK_SIZE, evt_log_drain,
+		NULL, NULL, NULL, K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+#if defined(CONFIG_SHELL)
+static const struct shell *dump_sh;
+
+static void evt_shell_print(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	shell_vfprintf(dump_sh, SHELL_NORMAL, fmt, ap);
+	va_end(ap);
+}
+
+static int cmd_evt_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t first;
+
+	k_mutex_lock(&history_lock, K_FOREVER);
+
+	dump_sh = sh;
+	first = history_cnt > EVT_LOG_SIZE ? history_cnt - EVT_LOG_SIZE : 0;
+
+	for (uint32_t i = first; i < history_cnt; i++) {
+		evt_print(&history[i & EVT_LOG_MASK], evt_shell_print);
+	}
+
+	k_mutex_unlock(&history_lock);
+
+	shell_print(sh, "%u events logged, %u dropped, %u pending",
+		    history_cnt, (uint32_t)atomic_get(&dropped),
+		    (uint32_t)(atomic_get(&head) - atomic_get(&tail)));
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(evt_cmds,
+	SHELL_CMD(dump, NULL, "Print the most recent received messages",
+		  cmd_evt_dump),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(evt, &evt_cmds, "Received message log", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,27 @@
+/* evt_log.h - Deferred log of received mesh messages */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EVT_LOG_H__
+#define EVT_LOG_H__
+
+#include <stdint.h>
+
+/** Record a received message without formatting it.
+ *
+ *  The event is timestamped in microseconds of uptime, stored in a
+ *  lock-free ring and printed later by a low priority thread. If the ring
+ *  is full, the event is dropped and counted.
+ *  The ring has a single producer, so this must only be called from the
+ *  Bluetooth RX context that runs the model message handlers.
+ *
+ *  @param opcode Opcode of the received message.
+ *  @param src    Source address of the message.
+ *  @param ttl    TTL the message was received with.
+ *  @param state  OnOff state carried by the message.
+ */
+void evt_log_put(uint32_t opcode, uint16_t src, uint8_t ttl, uint8_t state);
+
+#endif /* EVT_LOG_H__ */
@@ -0,0 +1,164 @@
+/* friend_stats.c - Per Low Power Node friendship statistics */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "friend_stats.h"
+
+static struct friend_lpn_stats lpns[CONFIG_BT_MESH_FRIEND_LPN_COUNT];
+
+/* Totals since boot */
+static struct {
+	uint32_t established;
+	uint32_t terminated;
+	/* Most friendships held at once, to size the friend queue pool */
+	uint32_t active;
+	uint32_t peak;
+	/* Friendships the stack accepted that didn't fit in the table */
+	uint32_t untracked;
+} totals;
+
+static struct k_spinlock lock;
+
+static struct friend_lpn_stats *lpn_find(uint16_t net_idx, uint16_t addr)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(lpns); i++) {
+		if (lpns[i].addr == addr && lpns[i].net_idx == net_idx) {
+			return &lpns[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void friend_established(uint16_t net_idx, uint16_t lpn_addr,
+			       uint8_t recv_delay, uint32_t polltimeout)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct friend_lpn_stats *lpn = lpn_find(net_idx, lpn_addr);
+
+	if (!lpn) {
+		lpn = lpn_find(0, BT_MESH_ADDR_UNASSIGNED);
+	}
+
+	totals.established++;
+	totals.active++;
+	totals.peak = MAX(totals.peak, totals.active);
+
+	if (lpn) {
+		*lpn = (struct friend_lpn_stats) {
+			.addr = lpn_addr,
+			.net_idx = net_idx,
+			.recv_delay = recv_delay,
+			.poll_timeout = polltimeout,
+			.since = k_uptime_get(),
+		};
+		lpn->last_poll = lpn->since;
+	} else {
+		totals.untracked++;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+static void friend_terminated(uint16_t net_idx, uint16_t lpn_addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct friend_lpn_stats *lpn = lpn_find(net_idx, lpn_addr);
+
+	totals.terminated++;
+	totals.active--;
+
+	if (lpn) {
+		*lpn = (struct friend_lpn_stats) {};
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+static void friend_polled(uint16_t net_idx, uint16_t lpn_addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct friend_lpn_stats *lpn = lpn_find(net_idx, lpn_addr);
+	int64_t now = k_uptime_get();
+
+	if (lpn) {
+		lpn->poll_interval_max = MAX(lpn->poll_interval_max,
+					     now - lpn->last_poll);
+		lpn->last_poll = now;
+		lpn->polls++;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+BT_MESH_FRIEND_CB_DEFINE(friend_stats) = {
+	.established = friend_established,
+	.terminated = friend_terminated,
+	.polled = friend_polled,
+};
+
+bool friend_stats_get(size_t idx, struct friend_lpn_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*stats = lpns[idx];
+
+	k_spin_unlock(&lock, key);
+
+	return stats->addr != BT_MESH_ADDR_UNASSIGNED;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_friend_status(const struct shell *sh, size_t argc, char **argv)
+{
+	int64_t now = k_uptime_get();
+	size_t active = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lpns); i++) {
+		struct friend_lpn_stats lpn;
+		uint32_t rate;
+		uint32_t age;
+
+		if (!friend_stats_get(i, &lpn)) {
+			continue;
+		}
+
+		active++;
+		age = MAX(now - lpn.since, 1);
+		rate = (uint64_t)lpn.polls * 60 * MSEC_PER_SEC / age;
+
+		shell_print(sh, "0x%04x: %u polls in %u s (%u/min, max "
+			    "interval %u ms), poll timeout %u ms, receive "
+			    "delay %u ms", lpn.addr, lpn.polls,
+			    age / MSEC_PER_SEC, rate, lpn.poll_interval_max,
+			    lpn.poll_timeout, lpn.recv_delay);
+	}
+
+	/* Queue buffers are reserved for every friendship the stack can
+	 * hold, whether it is in use or not. The stack doesn't report how
+	 * many of them are in use, or the messages it drops when a queue is
+	 * full.
+	 */
+	shell_print(sh, "%u of %u friendships (peak %u), %u queue entries "
+		    "each", active, CONFIG_BT_MESH_FRIEND_LPN_COUNT,
+		    totals.peak, CONFIG_BT_MESH_FRIEND_QUEUE_SIZE);
+	shell_print(sh, "established: %u, terminated: %u, untracked: %u",
+		    totals.established, totals.terminated, totals.untracked);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(friend_cmds,
+	SHELL_CMD(status, NULL, "Print per Low Power Node statistics",
+		  cmd_friend_status),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(friend, &friend_cmds, "Friend feature", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,37 @@
+/* friend_stats.h - Per Low Power Node friendship statistics */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FRIEND_STATS_H__
+#define FRIEND_STATS_H__
+
+#include <zephyr/kernel.h>
+
+/** Statistics of one friendship */
+struct friend_lpn_stats {
+	/* Unicast address of the Low Power Node, unassigned if unused */
+	uint16_t addr;
+	uint16_t net_idx;
+	/* Receive delay and poll timeout requested by the node */
+	uint8_t recv_delay;
+	uint32_t poll_timeout;
+	/* Uptime when the friendship was established */
+	int64_t since;
+	int64_t last_poll;
+	uint32_t polls;
+	/* Longest time between two polls */
+	uint32_t poll_interval_max;
+};
+
+/** Get the statistics of a friendship.
+ *
+ *  @param idx   Friendship index, up to CONFIG_BT_MESH_FRIEND_LPN_COUNT.
+ *  @param stats Statistics to fill in.
+ *
+ *  @return true if @p idx is an established friendship.
+ */
+bool friend_stats_get(size_t idx, struct friend_lpn_stats *stats);
+
+#endif /* FRIEND_STATS_H__ */
@@ -0,0 +1,116 @@
+/* fuzz.c - libFuzzer harness for the model message handlers */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "fuzz.h"
+
+#define FUZZ_HDR_LEN    7
+#define FUZZ_MODELS_MAX 16
+
+/* Set by the native_sim libFuzzer glue before it raises the fuzz IRQ */
+extern const uint8_t *posix_fuzz_buf;
+extern size_t posix_fuzz_sz;
+
+static K_SEM_DEFINE(fuzz_sem, 0, 1);
+
+static const struct bt_mesh_model *targets[FUZZ_MODELS_MAX];
+static size_t target_count;
+
+static void fuzz_isr(const void *arg)
+{
+	/* Run the handler in a thread, like the access layer does */
+	k_sem_give(&fuzz_sem);
+}
+
+static size_t op_count(const struct bt_mesh_model *model)
+{
+	size_t count = 0;
+
+	while (model->op[count].func) {
+		count++;
+	}
+
+	return count;
+}
+
+static void fuzz_one(const uint8_t *data, size_t len)
+{
+	const struct bt_mesh_model *model;
+	const struct bt_mesh_model_op *op;
+	struct bt_mesh_msg_ctx ctx = {
+		.net_idx = 0,
+		.app_idx = 0,
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+	struct net_buf_simple buf;
+	size_t ops;
+
+	if (len < FUZZ_HDR_LEN || !target_count) {
+		return;
+	}
+
+	model = targets[data[0] % target_count];
+	ops = op_count(model);
+	if (!ops) {
+		return;
+	}
+
+	op = &model->op[data[1] % ops];
+	ctx.addr = sys_get_le16(&data[2]);
+	ctx.recv_dst = sys_get_le16(&data[4]);
+	ctx.recv_ttl = data[6] & BT_MESH_TTL_MAX;
+
+	data += FUZZ_HDR_LEN;
+	len = MIN(len - FUZZ_HDR_LEN, BT_MESH_RX_SDU_MAX);
+
+	/* The network layer only accepts unicast sources, and the access
+	 * layer checks the payload length against the handler table.
+	 */
+	if (!BT_MESH_ADDR_IS_UNICAST(ctx.addr)) {
+		return;
+	}
+
+	if ((op->len >= 0 && len < (size_t)op->len) ||
+	    (op->len < 0 && len != (size_t)-op->len)) {
+		return;
+	}
+
+	/* Point at the fuzzer's own copy, so AddressSanitizer catches reads
+	 * past the end of the payload.
+	 */
+	net_buf_simple_init_with_data(&buf, (void *)data, len);
+
+	(void)op->func(model, &ctx, &buf);
+}
+
+FUNC_NORETURN void fuzz_run(const struct bt_mesh_elem *elem)
+{
+	/* The Configuration Server belongs to the stack */
+	for (size_t i = 0; i < elem->model_count; i++) {
+		if (elem->models[i].id != BT_MESH_MODEL_ID_CFG_SRV &&
+		    target_count < ARRAY_SIZE(targets)) {
+			targets[target_count++] = &elem->models[i];
+		}
+	}
+
+	for (size_t i = 0; i < elem->vnd_model_count; i++) {
+		if (target_count < ARRAY_SIZE(targets)) {
+			targets[target_count++] = &elem->vnd_models[i];
+		}
+	}
+
+	IRQ_CONNECT(CONFIG_ARCH_POSIX_FUZZ_IRQ, 0, fuzz_isr, NULL, 0);
+	irq_enable(CONFIG_ARCH_POSIX_FUZZ_IRQ);
+
+	while (true) {
+		k_sem_take(&fuzz_sem, K_FOREVER);
+		fuzz_one(posix_fuzz_buf, posix_fuzz_sz);
+	}
+}
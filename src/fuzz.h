@@ -0,0 +1,28 @@
+/* fuzz.h - libFuzzer harness for the model message handlers */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FUZZ_H__
+#define FUZZ_H__
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+
+/** Pass every libFuzzer input to a model message handler. Never returns.
+ *
+ *  An input starts with a 7 byte header: the index of the model among the
+ *  models of @p elem other than the Configuration Server, the index of the
+ *  opcode in its handler table, the little endian source and destination
+ *  addresses, and the received TTL. The rest is the access payload. Inputs
+ *  the access layer would drop, for their source address or a payload
+ *  length that doesn't match the opcode, are skipped.
+ *
+ *  Only built with CONFIG_ARCH_POSIX_LIBFUZZER, on native_sim.
+ *
+ *  @param elem Element whose models get the messages.
+ */
+FUNC_NORETURN void fuzz_run(const struct bt_mesh_elem *elem);
+
+#endif /* FUZZ_H__ */
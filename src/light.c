@@ -0,0 +1,234 @@
+/* light.c - LED lightness state and transition engine */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pwm.h>
+
+#include "light.h"
+
+#define PWM_LED0 DT_ALIAS(pwm_led0)
+
+#if DT_NODE_HAS_STATUS(PWM_LED0, okay)
+static const struct pwm_dt_spec pwm_led = PWM_DT_SPEC_GET(PWM_LED0);
+#else
+static const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios);
+#endif
+
+static struct {
+	uint16_t present;
+	uint16_t start;
+	uint16_t target;
+	/* Last non-zero target, restored when switching on */
+	uint16_t last;
+	/* Uptime when the transition starts, after its delay */
+	int64_t start_time;
+	uint32_t duration;
+	/* Lightness change per second while moving */
+	int32_t rate;
+} light = {
+	.last = UINT16_MAX,
+};
+
+static struct k_spinlock lock;
+static struct k_work_q *step_queue;
+static struct k_work_delayable step_work;
+static light_settled_cb settled_cb;
+
+static void light_settled(uint16_t lightness)
+{
+	if (settled_cb) {
+		settled_cb(lightness, light.last);
+	}
+}
+
+static void light_output(uint16_t lightness)
+{
+#if DT_NODE_HAS_STATUS(PWM_LED0, okay)
+	/* Light Lightness Actual is perceptual, the LED duty cycle is
+	 * linear.
+	 */
+	uint32_t linear = ((uint32_t)lightness * lightness) / UINT16_MAX;
+
+	pwm_set_pulse_dt(&pwm_led,
+			 (uint64_t)pwm_led.period * linear / UINT16_MAX);
+#else
+	gpio_pin_set_dt(&led, lightness > 0);
+#endif
+}
+
+/** Compute the lightness at @p now. Returns true when the transition is
+ *  over.
+ */
+static bool light_step_compute(int64_t now)
+{
+	int64_t elapsed = now - light.start_time;
+	int64_t value;
+
+	if (elapsed < 0) {
+		return false;
+	}
+
+	if (light.rate) {
+		value = light.start + light.rate * elapsed / MSEC_PER_SEC;
+		light.present = CLAMP(value, 0, UINT16_MAX);
+
+		return light.present == light.target;
+	}
+
+	if (elapsed >= light.duration) {
+		light.present = light.target;
+		return true;
+	}
+
+	value = (int64_t)light.target - light.start;
+	value = light.start + value * elapsed / light.duration;
+	light.present = value;
+
+	return false;
+}
+
+static void light_step(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int64_t now = k_uptime_get();
+	int64_t wait = light.start_time - now;
+	bool done = light_step_compute(now);
+	uint16_t present = light.present;
+
+	if (done) {
+		light.rate = 0;
+		light.duration = 0;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	light_output(present);
+
+	if (done) {
+		light_settled(present);
+	} else {
+		wait = MAX(wait, CONFIG_APP_TRANSITION_STEP_MS);
+		k_work_schedule_for_queue(step_queue, &step_work,
+					  K_MSEC(wait));
+	}
+}
+
+static void light_start(uint16_t target, uint32_t transition_ms,
+			int32_t rate, uint32_t delay_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	light.start = light.present;
+	light.target = target;
+	light.start_time = k_uptime_get() + delay_ms;
+	light.duration = transition_ms;
+	light.rate = rate;
+
+	if (target && !rate) {
+		light.last = target;
+	}
+
+	if (!transition_ms && !rate && !delay_ms) {
+		light.present = target;
+		light.duration = 0;
+		k_spin_unlock(&lock, key);
+
+		k_work_cancel_delayable(&step_work);
+		light_output(target);
+		light_settled(target);
+		return;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	k_work_reschedule_for_queue(step_queue, &step_work, K_MSEC(delay_ms));
+}
+
+void light_set(uint16_t target, uint32_t transition_ms, uint32_t delay_ms)
+{
+	light_start(target, transition_ms, 0, delay_ms);
+}
+
+void light_move(int32_t rate, uint32_t delay_ms)
+{
+	if (!rate) {
+		light_set(light_present(), 0, 0);
+		return;
+	}
+
+	light_start(rate > 0 ? UINT16_MAX : 0, 0, rate, delay_ms);
+}
+
+void light_restore(uint16_t lightness, uint16_t last)
+{
+	if (last) {
+		light.last = last;
+	}
+
+	light_set(lightness, 0, 0);
+}
+
+void light_onoff_set(bool on, uint32_t transition_ms, uint32_t delay_ms)
+{
+	light_set(on ? light.last : 0, transition_ms, delay_ms);
+}
+
+uint16_t light_present(void)
+{
+	return light.present;
+}
+
+uint16_t light_target(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint16_t target = (light.rate || light.duration) ? light.target :
+							    light.present;
+
+	k_spin_unlock(&lock, key);
+
+	return target;
+}
+
+uint32_t light_remaining(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int64_t end = light.start_time + light.duration;
+	uint32_t remaining = 0;
+
+	if (light.rate) {
+		remaining = LIGHT_REMAINING_UNKNOWN;
+	} else if (light.duration) {
+		remaining = MAX(end - k_uptime_get(), 0);
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return remaining;
+}
+
+int light_init(struct k_work_q *queue, light_settled_cb settled)
+{
+	step_queue = queue;
+	settled_cb = settled;
+	k_work_init_delayable(&step_work, light_step);
+
+#if DT_NODE_HAS_STATUS(PWM_LED0, okay)
+	if (!pwm_is_ready_dt(&pwm_led)) {
+		return -ENODEV;
+	}
+
+	return pwm_set_pulse_dt(&pwm_led, 0);
+#else
+	if (!gpio_is_ready_dt(&led)) {
+		return -ENODEV;
+	}
+
+	return gpio_pin_configure_dt(&led, GPIO_OUTPUT_INACTIVE);
+#endif
+}
@@ -0,0 +1,87 @@
+/* light.h - LED lightness state and transition engine */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LIGHT_H__
+#define LIGHT_H__
+
+#include <zephyr/kernel.h>
+
+/** Remaining time of a transition that has no defined end */
+#define LIGHT_REMAINING_UNKNOWN UINT32_MAX
+
+/** Callback for the lightness settling at a new value.
+ *
+ *  Called when a transition ends, but not for its intermediate steps.
+ *
+ *  @param lightness New lightness.
+ *  @param last      Last non-zero lightness.
+ */
+typedef void (*light_settled_cb)(uint16_t lightness, uint16_t last);
+
+/** Initialize the LED.
+ *
+ *  The LED is dimmed through the pwm-led0 devicetree alias if the board has
+ *  one, and switched on and off through led0 otherwise.
+ *
+ *  @param queue   Work queue that runs the transition steps.
+ *  @param settled Callback for the end of transitions, or NULL.
+ *
+ *  @return 0 on success, or (negative) error code otherwise.
+ */
+int light_init(struct k_work_q *queue, light_settled_cb settled);
+
+/** Restore the lightness after a reboot, without a transition.
+ *
+ *  @param lightness Lightness to set.
+ *  @param last      Last non-zero lightness, restored when switching on.
+ */
+void light_restore(uint16_t lightness, uint16_t last);
+
+/** Start a transition of the Light Lightness Actual state.
+ *
+ *  The lightness moves linearly from its present value to @p target over
+ *  @p transition_ms, starting after @p delay_ms. Intermediate values are
+ *  computed locally every CONFIG_APP_TRANSITION_STEP_MS. A new transition
+ *  replaces the one in progress.
+ *
+ *  @param target        Target lightness.
+ *  @param transition_ms Transition time in milliseconds, 0 for instant.
+ *  @param delay_ms      Delay before the transition starts.
+ */
+void light_set(uint16_t target, uint32_t transition_ms, uint32_t delay_ms);
+
+/** Move the lightness continuously until it reaches either end of its range.
+ *
+ *  @param rate     Change of lightness per second. 0 stops any transition at
+ *                  the present value.
+ *  @param delay_ms Delay before the move starts.
+ */
+void light_move(int32_t rate, uint32_t delay_ms);
+
+/** Switch the light on to its last non-zero lightness, or off.
+ *
+ *  @param on            New OnOff state.
+ *  @param transition_ms Transition time in milliseconds.
+ *  @param delay_ms      Delay before the transition starts.
+ */
+void light_onoff_set(bool on, uint32_t transition_ms, uint32_t delay_ms);
+
+/** Get the present lightness. */
+uint16_t light_present(void);
+
+/** Get the target lightness of the transition in progress, or the present
+ *  lightness if there is none.
+ */
+uint16_t light_target(void);
+
+/** Get the remaining time of the transition in progress.
+ *
+ *  @return Remaining time in milliseconds, 0 if there is no transition, or
+ *          LIGHT_REMAINING_UNKNOWN if the lightness is moving.
+ */
+uint32_t light_remaining(void);
+
+#endif /* LIGHT_H__ */
@@ -0,0 +1,151 @@
+/* lpn_energy.c - Low Power Node duty cycle and energy accounting */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "lpn_energy.h"
+#include "model_stats.h"
+
+static struct {
+	uint16_t friend_addr;
+	/* Receive window offered by the Friend, in milliseconds */
+	uint8_t recv_window;
+	uint32_t polls;
+	uint32_t poll_retries;
+	uint32_t friendships;
+	/* Time spent listening for Friend responses, in milliseconds */
+	uint32_t rx_ms;
+} lpn;
+
+static struct k_work_q *report_queue;
+static struct k_work_delayable report_work;
+
+static void lpn_established(uint16_t net_idx, uint16_t friend_addr,
+			    uint8_t queue_size, uint8_t recv_window)
+{
+	lpn.friend_addr = friend_addr;
+	lpn.recv_window = recv_window;
+	lpn.friendships++;
+
+	printk("Friendship with 0x%04x, receive window %u ms\n", friend_addr,
+	       recv_window);
+}
+
+static void lpn_terminated(uint16_t net_idx, uint16_t friend_addr)
+{
+	lpn.friend_addr = BT_MESH_ADDR_UNASSIGNED;
+
+	printk("Friendship with 0x%04x lost\n", friend_addr);
+}
+
+static void lpn_polled(uint16_t net_idx, uint16_t friend_addr, bool retry)
+{
+	lpn.polls++;
+	lpn.poll_retries += retry;
+
+	/* The scan stops early when the Friend answers, so the full window
+	 * is an upper bound.
+	 */
+	lpn.rx_ms += lpn.recv_window;
+}
+
+BT_MESH_LPN_CB_DEFINE(lpn_energy) = {
+	.established = lpn_established,
+	.terminated = lpn_terminated,
+	.polled = lpn_polled,
+};
+
+void lpn_energy_get(struct lpn_energy *energy)
+{
+	uint32_t elapsed_ms = MAX(k_uptime_get(), 1);
+	uint8_t xmit = bt_mesh_net_transmit_get();
+	uint32_t sent = 0;
+	uint64_t charge;
+
+	for (size_t i = 0; i < MODEL_STATS_COUNT; i++) {
+		sent += atomic_get(&model_stats[i].tx);
+	}
+
+	sent += atomic_get(&tx_stats.pub_retransmits);
+
+	energy->polls = lpn.polls;
+	energy->poll_retries = lpn.poll_retries;
+	energy->friendships = lpn.friendships;
+
+	/* Polls are sent once, application messages and their publication
+	 * retransmissions as many times as the network transmit state says.
+	 */
+	energy->adv_events = lpn.polls +
+			     sent * (BT_MESH_TRANSMIT_COUNT(xmit) + 1);
+	energy->tx_ms = (uint64_t)energy->adv_events *
+			CONFIG_APP_LPN_ADV_EVENT_US / USEC_PER_MSEC;
+	energy->rx_ms = lpn.rx_ms;
+
+	/* Charge in uA x ms */
+	charge = (uint64_t)energy->tx_ms * CONFIG_APP_LPN_TX_CURRENT_UA +
+		 (uint64_t)energy->rx_ms * CONFIG_APP_LPN_RX_CURRENT_UA +
+		 (uint64_t)(elapsed_ms - MIN(elapsed_ms,
+					     energy->tx_ms + energy->rx_ms)) *
+		 CONFIG_APP_LPN_SLEEP_CURRENT_UA;
+
+	energy->avg_ua = charge / elapsed_ms;
+}
+
+static void lpn_energy_report(struct k_work *work)
+{
+	struct lpn_energy energy;
+
+	lpn_energy_get(&energy);
+
+	printk("lpn energy polls %u tx %u ms rx %u ms avg %u uA\n",
+	       energy.polls, energy.tx_ms, energy.rx_ms, energy.avg_ua);
+
+	k_work_schedule_for_queue(report_queue, &report_work,
+				  K_SECONDS(CONFIG_APP_LPN_REPORT_INTERVAL_S));
+}
+
+void lpn_energy_init(struct k_work_q *queue)
+{
+	report_queue = queue;
+	k_work_init_delayable(&report_work, lpn_energy_report);
+
+	if (CONFIG_APP_LPN_REPORT_INTERVAL_S) {
+		k_work_schedule_for_queue(
+			report_queue, &report_work,
+			K_SECONDS(CONFIG_APP_LPN_REPORT_INTERVAL_S));
+	}
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_lpn_status(const struct shell *sh, size_t argc, char **argv)
+{
+	struct lpn_energy energy;
+
+	lpn_energy_get(&energy);
+
+	shell_print(sh, "friend:      0x%04x (%u friendships)",
+		    lpn.friend_addr, energy.friendships);
+	shell_print(sh, "polls:       %u (%u retries)", energy.polls,
+		    energy.poll_retries);
+	shell_print(sh, "adv events:  %u", energy.adv_events);
+	shell_print(sh, "radio tx/rx: %u/%u ms in %u s", energy.tx_ms,
+		    energy.rx_ms, k_uptime_get_32() / MSEC_PER_SEC);
+	shell_print(sh, "charge:      %u uAh per hour", energy.avg_ua);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(lpn_cmds,
+	SHELL_CMD(status, NULL, "Print duty cycle and energy estimate",
+		  cmd_lpn_status),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(lpn, &lpn_cmds, "Low Power Node", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,45 @@
+/* lpn_energy.h - Low Power Node duty cycle and energy accounting */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LPN_ENERGY_H__
+#define LPN_ENERGY_H__
+
+#include <zephyr/kernel.h>
+
+/** Estimated radio activity and charge since boot */
+struct lpn_energy {
+	uint32_t polls;
+	/* Polls that were retries of a poll the Friend didn't answer */
+	uint32_t poll_retries;
+	uint32_t friendships;
+	/* Advertising events sent, for polls and application messages */
+	uint32_t adv_events;
+	/* Radio time in milliseconds */
+	uint32_t tx_ms;
+	uint32_t rx_ms;
+	/* Average current in microamperes, i.e. the charge per hour in uAh */
+	uint32_t avg_ua;
+};
+
+/** Start the energy accounting.
+ *
+ *  Prints the estimate every CONFIG_APP_LPN_REPORT_INTERVAL_S.
+ *
+ *  @param queue Work queue to print the report from.
+ */
+void lpn_energy_init(struct k_work_q *queue);
+
+/** Estimate the radio activity and charge since boot.
+ *
+ *  Radio time is derived from the number of advertising events sent and
+ *  the receive window of every poll, and the charge from the currents in
+ *  the CONFIG_APP_LPN_*_CURRENT_UA options.
+ *
+ *  @param energy Estimate to fill in.
+ */
+void lpn_energy_get(struct lpn_energy *energy);
+
+#endif /* LPN_ENERGY_H__ */
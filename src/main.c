@@ -14,231 +14,2212 @@
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/hwinfo.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/random/random.h>
+#include <zephyr/shell/shell.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/mesh.h>
 
-#define LED0 DT_ALIAS(led0)
+#include "app_state.h"
+#include "bench.h"
+#include "dup_density.h"
+#include "evt_log.h"
+#include "fuzz.h"
+#include "light.h"
+#include "lpn_energy.h"
+#include "model_stats.h"
+#include "msg_codec.h"
+#include "relay_policy.h"
+#include "scene.h"
+#include "sub_table.h"
+#include "tid_cache.h"
+
 #define BUTTON0 DT_ALIAS(sw0)
 
-#define LED0_DEV DT_PHANDLE(LED0, gpios)
-#define LED0_PIN DT_PHA(LED0, gpios, pin)
-#define LED0_FLAGS DT_PHA(LED0, gpios, flags)
-#define BUTTON0_DEV DT_PHANDLE(BUTTON0, gpios)
-#define BUTTON0_PIN DT_PHA(BUTTON0, gpios, pin)
-#define BUTTON0_FLAGS DT_PHA(BUTTON0, gpios, flags)
+#define BUTTON0_DEV DT_PHANDLE(BUTTON0, gpios)
+#define BUTTON0_PIN DT_PHA(BUTTON0, gpios, pin)
+#define BUTTON0_FLAGS DT_PHA(BUTTON0, gpios, flags)
+
+#define OP_ONOFF_GET       BT_MESH_MODEL_OP_2(0x82, 0x01)
+#define OP_ONOFF_SET       BT_MESH_MODEL_OP_2(0x82, 0x02)
+#define OP_ONOFF_SET_UNACK BT_MESH_MODEL_OP_2(0x82, 0x03)
+#define OP_ONOFF_STATUS    BT_MESH_MODEL_OP_2(0x82, 0x04)
+
+#define OP_LEVEL_GET             BT_MESH_MODEL_OP_2(0x82, 0x05)
+#define OP_LEVEL_SET             BT_MESH_MODEL_OP_2(0x82, 0x06)
+#define OP_LEVEL_SET_UNACK       BT_MESH_MODEL_OP_2(0x82, 0x07)
+#define OP_LEVEL_STATUS          BT_MESH_MODEL_OP_2(0x82, 0x08)
+#define OP_LEVEL_DELTA_SET       BT_MESH_MODEL_OP_2(0x82, 0x09)
+#define OP_LEVEL_DELTA_SET_UNACK BT_MESH_MODEL_OP_2(0x82, 0x0a)
+#define OP_LEVEL_MOVE_SET        BT_MESH_MODEL_OP_2(0x82, 0x0b)
+#define OP_LEVEL_MOVE_SET_UNACK  BT_MESH_MODEL_OP_2(0x82, 0x0c)
+
+#define OP_LIGHTNESS_GET       BT_MESH_MODEL_OP_2(0x82, 0x4b)
+#define OP_LIGHTNESS_SET       BT_MESH_MODEL_OP_2(0x82, 0x4c)
+#define OP_LIGHTNESS_SET_UNACK BT_MESH_MODEL_OP_2(0x82, 0x4d)
+#define OP_LIGHTNESS_STATUS    BT_MESH_MODEL_OP_2(0x82, 0x4e)
+
+#define OP_SCENE_GET             BT_MESH_MODEL_OP_2(0x82, 0x41)
+#define OP_SCENE_RECALL          BT_MESH_MODEL_OP_2(0x82, 0x42)
+#define OP_SCENE_RECALL_UNACK    BT_MESH_MODEL_OP_2(0x82, 0x43)
+#define OP_SCENE_STATUS          BT_MESH_MODEL_OP_1(0x5e)
+#define OP_SCENE_REGISTER_GET    BT_MESH_MODEL_OP_2(0x82, 0x44)
+#define OP_SCENE_REGISTER_STATUS BT_MESH_MODEL_OP_2(0x82, 0x45)
+#define OP_SCENE_STORE           BT_MESH_MODEL_OP_2(0x82, 0x46)
+#define OP_SCENE_STORE_UNACK     BT_MESH_MODEL_OP_2(0x82, 0x47)
+#define OP_SCENE_DELETE          BT_MESH_MODEL_OP_2(0x82, 0x9e)
+#define OP_SCENE_DELETE_UNACK    BT_MESH_MODEL_OP_2(0x82, 0x9f)
+
+/* Generic Transition Time field: 6-bit number of steps and 2-bit step
+ * resolution.
+ */
+#define TRANSITION_STEPS_UNKNOWN 0x3f
+#define TRANSITION_STEPS_MAX     0x3e
+/* Delay fields are in 5 millisecond steps */
+#define DELAY_STEP_MS            5
+
+#define MOD_VND_ONOFF_BATCH 0x0001
+#define OP_VND_BATCH_SET    BT_MESH_MODEL_OP_3(0x01, BT_COMP_ID_LF)
+#define OP_VND_STATS_GET    BT_MESH_MODEL_OP_3(0x02, BT_COMP_ID_LF)
+#define OP_VND_STATS_STATUS BT_MESH_MODEL_OP_3(0x03, BT_COMP_ID_LF)
+#define OP_VND_RELAY_GET    BT_MESH_MODEL_OP_3(0x04, BT_COMP_ID_LF)
+#define OP_VND_RELAY_STATUS BT_MESH_MODEL_OP_3(0x05, BT_COMP_ID_LF)
+
+/* Each batched entry is a 16-bit target address followed by the state */
+#define BATCH_ENTRY_LEN sizeof(struct msg_batch_entry)
+
+static uint16_t device_addr;
+static bool onoff;
+
+/* Set once the first message after boot has been sent */
+static atomic_t boot_tx_done;
+
+static const struct device *const button_dev = DEVICE_DT_GET(BUTTON0_DEV);
+static struct k_work *button_work;
+static uint32_t button_submit_cyc;
+
+/* All mesh TX work runs on its own queue, so it isn't held up by settings,
+ * flash writes or the Bluetooth stack's deferred work on the system
+ * workqueue.
+ */
+static struct k_work_q app_workq;
+static K_THREAD_STACK_DEFINE(app_workq_stack, CONFIG_APP_WORKQ_STACK_SIZE);
+
+/* Button edges restart the debounce timer, and a press is only accepted
+ * once the contact has settled in the active state. Accepted presses closer
+ * together than CONFIG_APP_BUTTON_MIN_INTERVAL_MS are dropped as well.
+ */
+static int64_t button_last_press;
+
+static void button_debounced(struct k_timer *timer)
+{
+	int64_t now = k_uptime_get();
+
+	if (gpio_pin_get(button_dev, BUTTON0_PIN) <= 0) {
+		/* Bounce on release */
+		atomic_inc(&button_stats.bounces);
+		return;
+	}
+
+	if (button_last_press &&
+	    now - button_last_press < CONFIG_APP_BUTTON_MIN_INTERVAL_MS) {
+		atomic_inc(&button_stats.rate_limited);
+		return;
+	}
+
+	button_last_press = now;
+	atomic_inc(&button_stats.presses);
+
+	/* Time the oldest press in the queue */
+	if (!k_work_is_pending(button_work)) {
+		button_submit_cyc = k_cycle_get_32();
+	}
+
+	k_work_submit_to_queue(&app_workq, button_work);
+}
+
+static K_TIMER_DEFINE(button_timer, button_debounced, NULL);
+
+static void button_cb(const struct device *port, struct gpio_callback *cb,
+		      gpio_port_pins_t pins)
+{
+	if (k_timer_remaining_get(&button_timer)) {
+		atomic_inc(&button_stats.bounces);
+	}
+
+	k_timer_start(&button_timer, K_MSEC(CONFIG_APP_BUTTON_DEBOUNCE_MS),
+		      K_NO_WAIT);
+}
+
+static int button_init(struct k_work *button_pressed)
+{
+	int err;
+
+	err = gpio_pin_configure(button_dev, BUTTON0_PIN,
+				 BUTTON0_FLAGS | GPIO_INPUT);
+	if (err) {
+		return err;
+	}
+
+	static struct gpio_callback gpio_cb;
+
+	err = gpio_pin_interrupt_configure(button_dev, BUTTON0_PIN,
+					   GPIO_INT_EDGE_TO_ACTIVE);
+	if (err) {
+		return err;
+	}
+
+	button_work = button_pressed;
+
+	gpio_init_callback(&gpio_cb, button_cb, BIT(BUTTON0_PIN));
+	gpio_add_callback(button_dev, &gpio_cb);
+
+	return 0;
+}
+
+static void light_settled(uint16_t lightness, uint16_t last)
+{
+	app_state_set(APP_STATE_LIGHTNESS, lightness);
+	app_state_set(APP_STATE_LIGHTNESS_LAST, last);
+	app_state_set(APP_STATE_SCENE, scene_current(lightness));
+}
+
+int board_init(struct k_work *button_pressed)
+{
+	int err;
+
+	err = light_init(&app_workq, light_settled);
+	if (err) {
+		return err;
+	}
+
+	return button_init(button_pressed);
+}
+
+static const char *const onoff_str[] = { "off", "on" };
+
+static void onoff_tx_unblock(void);
+static void onoff_tx_pub_done(void);
+
+/** Report the time from boot until the node is back in operation. */
+static void boot_tx_mark(void)
+{
+	if (atomic_set(&boot_tx_done, 1) == 0) {
+		printk("First message sent %u ms after boot\n",
+		       k_uptime_get_32());
+	}
+}
+
+static void model_send_end(int err, void *cb_data)
+{
+	struct model_stats *stats = cb_data;
+
+	if (err) {
+		atomic_inc(&stats->tx_err);
+	} else {
+		boot_tx_mark();
+	}
+
+	atomic_dec(&tx_stats.inflight);
+
+	onoff_tx_unblock();
+}
+
+static const struct bt_mesh_send_cb model_send_cb = {
+	.end = model_send_end,
+};
+
+/** Send a model message and account for it in the model statistics.
+ *
+ *  Returns -ENOBUFS if the stack has no buffers left for the message.
+ */
+static int model_send(const struct bt_mesh_model *model,
+		      struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	atomic_val_t inflight;
+	int err;
+
+	/* Count the message before sending, as the send callback may fire
+	 * before bt_mesh_model_send() returns.
+	 */
+	inflight = atomic_inc(&tx_stats.inflight) + 1;
+
+	err = bt_mesh_model_send(model, ctx, buf, &model_send_cb,
+				 model->user_data);
+	model_stats_tx(model->user_data, start, err);
+
+	if (err) {
+		atomic_dec(&tx_stats.inflight);
+
+		if (err == -ENOBUFS) {
+			atomic_inc(&tx_stats.nobufs);
+		}
+	} else if (inflight > atomic_get(&tx_stats.inflight_max)) {
+		atomic_set(&tx_stats.inflight_max, inflight);
+	}
+
+	return err;
+}
+
+/* Transition Time and Delay fields, shared by the OnOff, Level, Lightness and
+ * Scene messages
+ */
+static const uint32_t transition_res_ms[] = { 100, 1000, 10000, 600000 };
+
+static uint32_t transition_time_decode(uint8_t tt)
+{
+	return (tt & BIT_MASK(6)) * transition_res_ms[tt >> 6];
+}
+
+static uint8_t transition_time_encode(uint32_t ms)
+{
+	if (!ms) {
+		return 0;
+	}
+
+	if (ms == LIGHT_REMAINING_UNKNOWN) {
+		return TRANSITION_STEPS_UNKNOWN;
+	}
+
+	for (uint8_t res = 0; res < ARRAY_SIZE(transition_res_ms); res++) {
+		uint32_t steps = DIV_ROUND_UP(ms, transition_res_ms[res]);
+
+		if (steps <= TRANSITION_STEPS_MAX) {
+			return (res << 6) | steps;
+		}
+	}
+
+	return (3 << 6) | TRANSITION_STEPS_MAX;
+}
+
+/** Get the optional Transition Time and Delay fields of a set message.
+ *
+ *  @param transition Transition fields, or NULL if the message has none.
+ *
+ *  @return false if the fields are present and invalid.
+ */
+static bool transition_get(const struct msg_transition *transition,
+			   uint32_t *transition_ms, uint32_t *delay_ms)
+{
+	*transition_ms = 0;
+	*delay_ms = 0;
+
+	if (!transition) {
+		return true;
+	}
+
+	if ((transition->tt & BIT_MASK(6)) == TRANSITION_STEPS_UNKNOWN) {
+		return false;
+	}
+
+	*transition_ms = transition_time_decode(transition->tt);
+	*delay_ms = transition->delay * DELAY_STEP_MS;
+
+	return true;
+}
+
+static void onoff_srv_apply(uint8_t val, uint32_t transition_ms,
+			    uint32_t delay_ms)
+{
+	light_onoff_set(val, transition_ms, delay_ms);
+}
+
+/** Fill in an OnOff Status, with the target state and remaining time while
+ *  the light is fading.
+ */
+static void onoff_status_fill(struct net_buf_simple *buf)
+{
+	uint32_t remaining = light_remaining();
+
+	bt_mesh_model_msg_init(buf, OP_ONOFF_STATUS);
+	net_buf_simple_add_u8(buf, light_present() > 0);
+
+	if (remaining) {
+		net_buf_simple_add_u8(buf, light_target() > 0);
+		net_buf_simple_add_u8(buf, transition_time_encode(remaining));
+	}
+}
+
+static int onoff_status_send(const struct bt_mesh_model *model,
+			     struct bt_mesh_msg_ctx *ctx)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_ONOFF_STATUS,
+				 sizeof(struct msg_onoff_status));
+	onoff_status_fill(&buf);
+
+	/* Spread out the responses to group addressed requests */
+	ctx->rnd_delay = !BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst);
+
+	return model_send(model, ctx, &buf);
+}
+
+static int gen_onoff_get(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	err = onoff_status_send(model, ctx);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+/** Check whether a message was sent by this node and looped back. */
+static bool onoff_is_local(const struct bt_mesh_model *model,
+			   const struct bt_mesh_msg_ctx *ctx)
+{
+	return ctx->addr == bt_mesh_model_elem(model)->rt->addr;
+}
+
+/* OnOff Set payloads: the state alone as sent by earlier versions of this
+ * application, the state and the sender address as sent by legacy peers, and
+ * the spec format with a TID and optional transition fields. The source of
+ * the message stands in for the legacy address.
+ */
+#define ONOFF_SET_LENS                                                         \
+	(BIT(1) | BIT(3) | MSG_LENS_TRANSITION(struct msg_onoff_set))
+
+/* Length of the spec format without the transition fields */
+#define ONOFF_SET_TID_LEN offsetof(struct msg_onoff_set, transition)
+
+static int onoff_srv_set(uint32_t op, struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	const struct msg_onoff_set *msg = msg_view(buf, ONOFF_SET_LENS);
+	uint32_t transition_ms = CONFIG_APP_ONOFF_TRANSITION_MS;
+	uint32_t delay_ms = 0;
+
+	/* Values above 1 are prohibited */
+	if (!msg || msg->onoff > 1) {
+		return -EINVAL;
+	}
+
+	if (buf->len == sizeof(*msg) &&
+	    !transition_get(&msg->transition, &transition_ms, &delay_ms)) {
+		return -EINVAL;
+	}
+
+	/* Retransmissions of a transaction are answered, but not applied or
+	 * logged again
+	 */
+	if ((buf->len == ONOFF_SET_TID_LEN || buf->len == sizeof(*msg)) &&
+	    tid_cache_replay(ctx->addr, ctx->recv_dst, msg->tid)) {
+		return 0;
+	}
+
+	evt_log_put(op, ctx->addr, ctx->recv_ttl, msg->onoff);
+	onoff_srv_apply(msg->onoff, transition_ms, delay_ms);
+
+	return 0;
+}
+
+static int gen_onoff_set_unack(const struct bt_mesh_model *model,
+			       struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err = 0;
+
+	if (!onoff_is_local(model, ctx)) {
+		err = onoff_srv_set(OP_ONOFF_SET_UNACK, ctx, buf);
+	}
+
+	if (err) {
+		model_stats_rejected(model->user_data, start);
+	} else {
+		model_stats_rx(model->user_data, start);
+	}
+
+	return err;
+}
+
+static int gen_onoff_set(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err = 0;
+
+	/* Don't act on or answer our own requests */
+	if (!onoff_is_local(model, ctx)) {
+		err = onoff_srv_set(OP_ONOFF_SET, ctx, buf);
+		if (err) {
+			model_stats_rejected(model->user_data, start);
+			return err;
+		}
+
+		err = onoff_status_send(model, ctx);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+/* The stack matches opcodes by scanning the op lists in order, so the
+ * opcodes controllers send most often come first. Payloads are validated by
+ * the handlers, the stack only checks the minimum length.
+ */
+static const struct bt_mesh_model_op gen_onoff_srv_op[] = {
+	{ OP_ONOFF_SET_UNACK, BT_MESH_LEN_MIN(1),   gen_onoff_set_unack },
+	{ OP_ONOFF_SET,       BT_MESH_LEN_MIN(1),   gen_onoff_set },
+	{ OP_ONOFF_GET,       BT_MESH_LEN_EXACT(0), gen_onoff_get },
+	BT_MESH_MODEL_OP_END,
+};
+
+/* Generic Level Server and Light Lightness Server
+ *
+ * Both drive the same Light Lightness Actual state, with
+ * Generic Level = Light Lightness Actual - 32768. Transitions are run by the
+ * node itself, so a controller only needs to send the target.
+ */
+
+static void light_status_add(struct net_buf_simple *buf, uint16_t present,
+			     uint16_t target)
+{
+	uint32_t remaining = light_remaining();
+
+	net_buf_simple_add_le16(buf, present);
+
+	if (remaining) {
+		net_buf_simple_add_le16(buf, target);
+		net_buf_simple_add_u8(buf, transition_time_encode(remaining));
+	}
+}
+
+static int level_status_send(const struct bt_mesh_model *model,
+			     struct bt_mesh_msg_ctx *ctx)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_LEVEL_STATUS, 5);
+	bt_mesh_model_msg_init(&buf, OP_LEVEL_STATUS);
+	light_status_add(&buf, light_present() - 32768,
+			 light_target() - 32768);
+
+	ctx->rnd_delay = !BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst);
+
+	return model_send(model, ctx, &buf);
+}
+
+static int gen_level_get(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	err = level_status_send(model, ctx);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static bool level_set(struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+	const struct msg_level_set *msg =
+		msg_view(buf, MSG_LENS_TRANSITION(struct msg_level_set));
+	uint32_t transition_ms;
+	uint32_t delay_ms;
+
+	if (!msg || !transition_get(MSG_TRANSITION(buf, msg), &transition_ms,
+				    &delay_ms)) {
+		return false;
+	}
+
+	light_set((int16_t)sys_le16_to_cpu(msg->level) + 32768, transition_ms,
+		  delay_ms);
+
+	return true;
+}
+
+/* Delta Set messages with the same source and TID are retransmissions of
+ * the same delta, and apply to the level the first one started from.
+ */
+static struct {
+	uint16_t src;
+	uint8_t tid;
+	int32_t base;
+} level_delta;
+
+static bool level_delta_set(struct bt_mesh_msg_ctx *ctx,
+			    struct net_buf_simple *buf)
+{
+	const struct msg_delta_set *msg =
+		msg_view(buf, MSG_LENS_TRANSITION(struct msg_delta_set));
+	uint32_t transition_ms;
+	uint32_t delay_ms;
+
+	if (!msg || !transition_get(MSG_TRANSITION(buf, msg), &transition_ms,
+				    &delay_ms)) {
+		return false;
+	}
+
+	if (level_delta.src != ctx->addr || level_delta.tid != msg->tid) {
+		level_delta.src = ctx->addr;
+		level_delta.tid = msg->tid;
+		level_delta.base = light_present();
+	}
+
+	light_set(CLAMP(level_delta.base +
+			(int64_t)(int32_t)sys_le32_to_cpu(msg->delta),
+			0, UINT16_MAX),
+		  transition_ms, delay_ms);
+
+	return true;
+}
+
+static bool level_move_set(struct bt_mesh_msg_ctx *ctx,
+			   struct net_buf_simple *buf)
+{
+	const struct msg_move_set *msg =
+		msg_view(buf, MSG_LENS_TRANSITION(struct msg_move_set));
+	uint32_t transition_ms;
+	uint32_t delay_ms;
+	int16_t delta;
+
+	if (!msg || !transition_get(MSG_TRANSITION(buf, msg), &transition_ms,
+				    &delay_ms)) {
+		return false;
+	}
+
+	delta = sys_le16_to_cpu(msg->delta);
+
+	/* Delta Level is the change per Transition Time, a zero transition
+	 * time stops the move.
+	 */
+	if (!transition_ms) {
+		light_move(0, 0);
+	} else {
+		light_move((int64_t)delta * MSEC_PER_SEC / transition_ms,
+			   delay_ms);
+	}
+
+	return true;
+}
+
+static int gen_level_set_common(const struct bt_mesh_model *model,
+				struct bt_mesh_msg_ctx *ctx,
+				struct net_buf_simple *buf,
+				bool (*set)(struct bt_mesh_msg_ctx *ctx,
+					    struct net_buf_simple *buf),
+				bool ack)
+{
+	uint32_t start = k_cycle_get_32();
+	bool valid;
+	int err = 0;
+
+	valid = set(ctx, buf);
+	if (!valid) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	if (ack) {
+		err = level_status_send(model, ctx);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int gen_level_set(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_set, true);
+}
+
+static int gen_level_set_unack(const struct bt_mesh_model *model,
+			       struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_set, false);
+}
+
+static int gen_delta_set(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_delta_set, true);
+}
+
+static int gen_delta_set_unack(const struct bt_mesh_model *model,
+			       struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_delta_set, false);
+}
+
+static int gen_move_set(const struct bt_mesh_model *model,
+			struct bt_mesh_msg_ctx *ctx,
+			struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_move_set, true);
+}
+
+static int gen_move_set_unack(const struct bt_mesh_model *model,
+			      struct bt_mesh_msg_ctx *ctx,
+			      struct net_buf_simple *buf)
+{
+	return gen_level_set_common(model, ctx, buf, level_move_set, false);
+}
+
+static const struct bt_mesh_model_op gen_level_srv_op[] = {
+	{ OP_LEVEL_SET_UNACK,       BT_MESH_LEN_MIN(3),   gen_level_set_unack },
+	{ OP_LEVEL_DELTA_SET_UNACK, BT_MESH_LEN_MIN(5),   gen_delta_set_unack },
+	{ OP_LEVEL_MOVE_SET_UNACK,  BT_MESH_LEN_MIN(3),   gen_move_set_unack },
+	{ OP_LEVEL_SET,             BT_MESH_LEN_MIN(3),   gen_level_set },
+	{ OP_LEVEL_DELTA_SET,       BT_MESH_LEN_MIN(5),   gen_delta_set },
+	{ OP_LEVEL_MOVE_SET,        BT_MESH_LEN_MIN(3),   gen_move_set },
+	{ OP_LEVEL_GET,             BT_MESH_LEN_EXACT(0), gen_level_get },
+	BT_MESH_MODEL_OP_END,
+};
+
+static int lightness_status_send(const struct bt_mesh_model *model,
+				 struct bt_mesh_msg_ctx *ctx)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_LIGHTNESS_STATUS, 5);
+	bt_mesh_model_msg_init(&buf, OP_LIGHTNESS_STATUS);
+	light_status_add(&buf, light_present(), light_target());
+
+	ctx->rnd_delay = !BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst);
+
+	return model_send(model, ctx, &buf);
+}
+
+static int lightness_get(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	err = lightness_status_send(model, ctx);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int lightness_set_common(const struct bt_mesh_model *model,
+				struct bt_mesh_msg_ctx *ctx,
+				struct net_buf_simple *buf, bool ack)
+{
+	uint32_t start = k_cycle_get_32();
+	const struct msg_lightness_set *msg =
+		msg_view(buf, MSG_LENS_TRANSITION(struct msg_lightness_set));
+	uint32_t transition_ms;
+	uint32_t delay_ms;
+	int err = 0;
+
+	if (!msg || !transition_get(MSG_TRANSITION(buf, msg), &transition_ms,
+				    &delay_ms)) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	light_set(sys_le16_to_cpu(msg->lightness), transition_ms, delay_ms);
+
+	if (ack) {
+		err = lightness_status_send(model, ctx);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int lightness_set(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	return lightness_set_common(model, ctx, buf, true);
+}
+
+static int lightness_set_unack(const struct bt_mesh_model *model,
+			       struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	return lightness_set_common(model, ctx, buf, false);
+}
+
+static const struct bt_mesh_model_op lightness_srv_op[] = {
+	{ OP_LIGHTNESS_SET_UNACK, BT_MESH_LEN_MIN(3),   lightness_set_unack },
+	{ OP_LIGHTNESS_SET,       BT_MESH_LEN_MIN(3),   lightness_set },
+	{ OP_LIGHTNESS_GET,       BT_MESH_LEN_EXACT(0), lightness_get },
+	BT_MESH_MODEL_OP_END,
+};
+
+static int lightness_srv_init(const struct bt_mesh_model *model)
+{
+	const struct bt_mesh_elem *elem = bt_mesh_model_elem(model);
+	const struct bt_mesh_model *level =
+		bt_mesh_model_find(elem, BT_MESH_MODEL_ID_GEN_LEVEL_SRV);
+	const struct bt_mesh_model *onoff =
+		bt_mesh_model_find(elem, BT_MESH_MODEL_ID_GEN_ONOFF_SRV);
+	int err;
+
+	/* The Light Lightness Server extends the Generic Level Server and,
+	 * through the Generic Power OnOff Server this sample doesn't have,
+	 * the Generic OnOff Server.
+	 */
+	err = bt_mesh_model_extend(model, level);
+	if (err) {
+		return err;
+	}
+
+	return bt_mesh_model_extend(model, onoff);
+}
+
+static const struct bt_mesh_model_cb lightness_srv_cb = {
+	.init = lightness_srv_init,
+};
+
+/* Scene Server and Scene Setup Server
+ *
+ * A scene captures the target lightness, so a single Scene Recall can set
+ * every light in a room.
+ */
+
+static int scene_status_send(const struct bt_mesh_model *model,
+			     struct bt_mesh_msg_ctx *ctx,
+			     enum scene_status status, uint16_t target)
+{
+	uint32_t remaining = light_remaining();
+
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_SCENE_STATUS, 6);
+	bt_mesh_model_msg_init(&buf, OP_SCENE_STATUS);
+	net_buf_simple_add_u8(&buf, status);
+
+	if (remaining && target) {
+		/* No scene is current until the transition completes */
+		net_buf_simple_add_le16(&buf, 0);
+		net_buf_simple_add_le16(&buf, target);
+		net_buf_simple_add_u8(&buf, transition_time_encode(remaining));
+	} else {
+		net_buf_simple_add_le16(&buf, scene_current(light_target()));
+	}
+
+	ctx->rnd_delay = !BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst);
+
+	return model_send(model, ctx, &buf);
+}
+
+static int scene_register_status_send(const struct bt_mesh_model *model,
+				      struct bt_mesh_msg_ctx *ctx,
+				      enum scene_status status)
+{
+	uint16_t numbers[CONFIG_APP_SCENE_COUNT];
+	size_t count = scene_list(numbers, ARRAY_SIZE(numbers));
+
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_SCENE_REGISTER_STATUS,
+				 3 + 2 * CONFIG_APP_SCENE_COUNT);
+	bt_mesh_model_msg_init(&buf, OP_SCENE_REGISTER_STATUS);
+	net_buf_simple_add_u8(&buf, status);
+	net_buf_simple_add_le16(&buf, scene_current(light_target()));
+
+	for (size_t i = 0; i < count; i++) {
+		net_buf_simple_add_le16(&buf, numbers[i]);
+	}
+
+	ctx->rnd_delay = !BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst);
+
+	return model_send(model, ctx, &buf);
+}
+
+static int scene_get(const struct bt_mesh_model *model,
+		     struct bt_mesh_msg_ctx *ctx,
+		     struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	err = scene_status_send(model, ctx, SCENE_SUCCESS, 0);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int scene_recall_common(const struct bt_mesh_model *model,
+			       struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf, bool ack)
+{
+	uint32_t start = k_cycle_get_32();
+	const struct msg_scene_recall *msg =
+		msg_view(buf, MSG_LENS_TRANSITION(struct msg_scene_recall));
+	enum scene_status status;
+	uint32_t transition_ms;
+	uint32_t delay_ms;
+	uint16_t lightness;
+	uint16_t number;
+	int err = 0;
+
+	number = msg ? sys_le16_to_cpu(msg->scene) : 0;
+
+	if (!number || !transition_get(MSG_TRANSITION(buf, msg),
+				       &transition_ms, &delay_ms)) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	status = scene_recall(number, &lightness);
+	if (status == SCENE_SUCCESS) {
+		light_set(lightness, transition_ms, delay_ms);
+	}
+
+	if (ack) {
+		err = scene_status_send(model, ctx, status,
+					status == SCENE_SUCCESS ? number : 0);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int scene_recall_ack(const struct bt_mesh_model *model,
+			    struct bt_mesh_msg_ctx *ctx,
+			    struct net_buf_simple *buf)
+{
+	return scene_recall_common(model, ctx, buf, true);
+}
+
+static int scene_recall_unack(const struct bt_mesh_model *model,
+			      struct bt_mesh_msg_ctx *ctx,
+			      struct net_buf_simple *buf)
+{
+	return scene_recall_common(model, ctx, buf, false);
+}
+
+static int scene_register_get(const struct bt_mesh_model *model,
+			      struct bt_mesh_msg_ctx *ctx,
+			      struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	err = scene_register_status_send(model, ctx, SCENE_SUCCESS);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static const struct bt_mesh_model_op scene_srv_op[] = {
+	{ OP_SCENE_RECALL_UNACK, BT_MESH_LEN_MIN(3),   scene_recall_unack },
+	{ OP_SCENE_RECALL,       BT_MESH_LEN_MIN(3),   scene_recall_ack },
+	{ OP_SCENE_GET,          BT_MESH_LEN_EXACT(0), scene_get },
+	{ OP_SCENE_REGISTER_GET, BT_MESH_LEN_EXACT(0), scene_register_get },
+	BT_MESH_MODEL_OP_END,
+};
+
+static int scene_setup_common(const struct bt_mesh_model *model,
+			      struct bt_mesh_msg_ctx *ctx,
+			      struct net_buf_simple *buf, bool store,
+			      bool ack)
+{
+	uint32_t start = k_cycle_get_32();
+	const struct msg_scene_number *msg =
+		msg_view(buf, MSG_LENS_EXACT(struct msg_scene_number));
+	uint16_t number = msg ? sys_le16_to_cpu(msg->scene) : 0;
+	enum scene_status status;
+	int err = 0;
+
+	if (!number) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	if (store) {
+		status = scene_store(number, light_target());
+	} else {
+		status = scene_delete(number);
+	}
+
+	if (ack) {
+		err = scene_register_status_send(model, ctx, status);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+static int scene_store_ack(const struct bt_mesh_model *model,
+			   struct bt_mesh_msg_ctx *ctx,
+			   struct net_buf_simple *buf)
+{
+	return scene_setup_common(model, ctx, buf, true, true);
+}
+
+static int scene_store_unack(const struct bt_mesh_model *model,
+			     struct bt_mesh_msg_ctx *ctx,
+			     struct net_buf_simple *buf)
+{
+	return scene_setup_common(model, ctx, buf, true, false);
+}
+
+static int scene_delete_ack(const struct bt_mesh_model *model,
+			    struct bt_mesh_msg_ctx *ctx,
+			    struct net_buf_simple *buf)
+{
+	return scene_setup_common(model, ctx, buf, false, true);
+}
+
+static int scene_delete_unack(const struct bt_mesh_model *model,
+			      struct bt_mesh_msg_ctx *ctx,
+			      struct net_buf_simple *buf)
+{
+	return scene_setup_common(model, ctx, buf, false, false);
+}
+
+static const struct bt_mesh_model_op scene_setup_srv_op[] = {
+	{ OP_SCENE_STORE,        BT_MESH_LEN_EXACT(2), scene_store_ack },
+	{ OP_SCENE_STORE_UNACK,  BT_MESH_LEN_EXACT(2), scene_store_unack },
+	{ OP_SCENE_DELETE,       BT_MESH_LEN_EXACT(2), scene_delete_ack },
+	{ OP_SCENE_DELETE_UNACK, BT_MESH_LEN_EXACT(2), scene_delete_unack },
+	BT_MESH_MODEL_OP_END,
+};
+
+static int scene_setup_srv_init(const struct bt_mesh_model *model)
+{
+	const struct bt_mesh_elem *elem = bt_mesh_model_elem(model);
+	const struct bt_mesh_model *scene =
+		bt_mesh_model_find(elem, BT_MESH_MODEL_ID_SCENE_SRV);
+
+	return bt_mesh_model_extend(model, scene);
+}
+
+static const struct bt_mesh_model_cb scene_setup_srv_cb = {
+	.init = scene_setup_srv_init,
+};
+
+/* Generic OnOff Client */
+
+static void onoff_txn_ack(uint16_t addr, uint8_t present);
+static void addr_probe_rx(uint16_t addr);
+
+static int gen_onoff_status(const struct bt_mesh_model *model,
+			    struct bt_mesh_msg_ctx *ctx,
+			    struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	const struct msg_onoff_status *msg =
+		msg_view(buf, BIT(1) | MSG_LENS_EXACT(struct msg_onoff_status));
+
+	if (!msg || msg->present > 1 ||
+	    (buf->len == sizeof(*msg) && msg->target > 1)) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	evt_log_put(OP_ONOFF_STATUS, ctx->addr, ctx->recv_ttl, msg->present);
+
+	addr_probe_rx(ctx->addr);
+
+	/* During a transition, the present state is still the old one */
+	if (IS_ENABLED(CONFIG_APP_ONOFF_ACKED)) {
+		onoff_txn_ack(ctx->addr, buf->len == sizeof(*msg) ?
+					 msg->target : msg->present);
+	}
+
+	model_stats_rx(model->user_data, start);
+
+	return 0;
+}
+
+static const struct bt_mesh_model_op gen_onoff_cli_op[] = {
+	{OP_ONOFF_STATUS, BT_MESH_LEN_MIN(1), gen_onoff_status},
+	BT_MESH_MODEL_OP_END,
+};
+
+/* Vendor Batched OnOff model */
+
+static bool onoff_srv_subscribed(uint16_t addr);
+
+static int vnd_batch_set(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	uint16_t own_addr = bt_mesh_model_elem(model)->rt->addr;
+	const struct msg_batch_entry *entries = (const void *)buf->data;
+	size_t count = buf->len / sizeof(*entries);
+
+	if (buf->len % sizeof(*entries)) {
+		goto reject;
+	}
+
+	/* A batch with any invalid entry is dropped as a whole, as it can't
+	 * come from a well behaved client.
+	 */
+	for (size_t i = 0; i < count; i++) {
+		if (entries[i].onoff > 1) {
+			goto reject;
+		}
+	}
+
+	if (onoff_is_local(model, ctx)) {
+		goto done;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		uint16_t target = sys_le16_to_cpu(entries[i].addr);
+		uint8_t val = entries[i].onoff;
+
+		if (target != own_addr && target != BT_MESH_ADDR_ALL_NODES &&
+		    !onoff_srv_subscribed(target)) {
+			continue;
+		}
+
+		evt_log_put(OP_VND_BATCH_SET, ctx->addr, ctx->recv_ttl,
+			    val);
+		onoff_srv_apply(val, CONFIG_APP_ONOFF_TRANSITION_MS, 0);
+	}
+
+done:
+	model_stats_rx(model->user_data, start);
+
+	return 0;
+
+reject:
+	model_stats_rejected(model->user_data, start);
+
+	return -EINVAL;
+}
+
+/** Answer a gateway polling the statistics of one of our models. */
+static int vnd_stats_get(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	uint8_t id = net_buf_simple_pull_u8(buf);
+	int err;
+
+	if (id >= MODEL_STATS_COUNT) {
+		model_stats_rejected(model->user_data, start);
+		return -EINVAL;
+	}
+
+	BT_MESH_MODEL_BUF_DEFINE(rsp, OP_VND_STATS_STATUS,
+				 1 + MODEL_STATS_ENCODED_LEN);
+	bt_mesh_model_msg_init(&rsp, OP_VND_STATS_STATUS);
+	net_buf_simple_add_u8(&rsp, id);
+	model_stats_encode(&model_stats[id], &rsp);
+
+	err = model_send(model, ctx, &rsp);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+
+#if defined(CONFIG_APP_RELAY_ADAPTIVE)
+/** Report the adaptive relay state, so a gateway can see which nodes have
+ *  backed off.
+ */
+static int vnd_relay_get(const struct bt_mesh_model *model,
+			 struct bt_mesh_msg_ctx *ctx,
+			 struct net_buf_simple *buf)
+{
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	BT_MESH_MODEL_BUF_DEFINE(rsp, OP_VND_RELAY_STATUS,
+				 RELAY_POLICY_ENCODED_LEN);
+	bt_mesh_model_msg_init(&rsp, OP_VND_RELAY_STATUS);
+	relay_policy_encode(&rsp);
+
+	err = model_send(model, ctx, &rsp);
+	model_stats_rx(model->user_data, start);
+
+	return err;
+}
+#endif
+
+static const struct bt_mesh_model_op vnd_batch_op[] = {
+	{ OP_VND_BATCH_SET, BT_MESH_LEN_MIN(BATCH_ENTRY_LEN), vnd_batch_set },
+	{ OP_VND_STATS_GET, BT_MESH_LEN_EXACT(1),             vnd_stats_get },
+#if defined(CONFIG_APP_RELAY_ADAPTIVE)
+	{ OP_VND_RELAY_GET, BT_MESH_LEN_EXACT(0),             vnd_relay_get },
+#endif
+	BT_MESH_MODEL_OP_END,
+};
+
+/** Refresh the OnOff Status published periodically by the stack, when the
+ *  Configuration Server has set a publish period.
+ */
+static int gen_onoff_srv_pub_update(const struct bt_mesh_model *model)
+{
+	onoff_status_fill(model->pub->msg);
+
+	return 0;
+}
+
+BT_MESH_MODEL_PUB_DEFINE(gen_onoff_srv_pub, gen_onoff_srv_pub_update,
+			 2 + sizeof(struct msg_onoff_status));
+
+/** Count the publication retransmissions of the Generic OnOff Client.
+ *
+ *  The client doesn't publish periodically, so the stack only calls this
+ *  for retransmissions, which are sent unchanged. The last one ends the
+ *  time the publication counts as in flight.
+ */
+static int gen_onoff_cli_pub_update(const struct bt_mesh_model *model)
+{
+	if (bt_mesh_model_pub_is_retransmission(model)) {
+		atomic_inc(&tx_stats.pub_retransmits);
+
+		if (BT_MESH_PUB_MSG_NUM(model->pub) ==
+		    BT_MESH_PUB_MSG_TOTAL(model->pub)) {
+			onoff_tx_pub_done();
+		}
+	}
+
+	return 0;
+}
+
+/* Room for the opcode, and the state and TID or the legacy sender address */
+BT_MESH_MODEL_PUB_DEFINE(gen_onoff_cli_pub, gen_onoff_cli_pub_update,
+			 2 + 1 + 2);
+
+/* Build time default of the client publication retransmissions, until the
+ * Configuration Server sets the publication parameters
+ */
+#define ONOFF_CLI_RETRANSMIT                                                   \
+	BT_MESH_PUB_TRANSMIT(CONFIG_APP_ONOFF_PUB_RETRANSMIT_COUNT,            \
+			     CONFIG_APP_ONOFF_PUB_RETRANSMIT_INTERVAL_MS)
+
+/* This application only needs one element to contain its models */
+static const struct bt_mesh_model models[] = {
+	BT_MESH_MODEL_CFG_SRV,
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_ONOFF_SRV, gen_onoff_srv_op,
+		      &gen_onoff_srv_pub, &model_stats[MODEL_STATS_ONOFF_SRV]),
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_ONOFF_CLI, gen_onoff_cli_op,
+		      &gen_onoff_cli_pub, &model_stats[MODEL_STATS_ONOFF_CLI]),
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_LEVEL_SRV, gen_level_srv_op, NULL,
+		      &model_stats[MODEL_STATS_LEVEL_SRV]),
+	BT_MESH_MODEL_CB(BT_MESH_MODEL_ID_LIGHT_LIGHTNESS_SRV, lightness_srv_op,
+			 NULL, &model_stats[MODEL_STATS_LIGHTNESS_SRV],
+			 &lightness_srv_cb),
+	BT_MESH_MODEL(BT_MESH_MODEL_ID_SCENE_SRV, scene_srv_op, NULL,
+		      &model_stats[MODEL_STATS_SCENE_SRV]),
+	BT_MESH_MODEL_CB(BT_MESH_MODEL_ID_SCENE_SETUP_SRV, scene_setup_srv_op,
+			 NULL, &model_stats[MODEL_STATS_SCENE_SETUP_SRV],
+			 &scene_setup_srv_cb),
+};
+
+static const struct bt_mesh_model vnd_models[] = {
+	BT_MESH_MODEL_VND(BT_COMP_ID_LF, MOD_VND_ONOFF_BATCH, vnd_batch_op,
+			  NULL, &model_stats[MODEL_STATS_VND]),
+};
+
+/* Index of the subscription list of the Generic OnOff Server in the stack,
+ * which only the Configuration Server changes. It is rebuilt after every
+ * message the Configuration Server may have handled, so Batched Set
+ * entries are never looked up with a scan of the list.
+ */
+SUB_TABLE_DEFINE(onoff_srv_groups, CONFIG_BT_MESH_MODEL_GROUP_COUNT);
+
+static void onoff_srv_groups_sync(void)
+{
+	(void)sub_table_set(&onoff_srv_groups, models[1].groups,
+			    models[1].groups_cnt);
+}
+
+/** Check both the application level subscriptions and the ones set through
+ *  the Configuration Server.
+ */
+static bool onoff_srv_subscribed(uint16_t addr)
+{
+	return sub_table_has(&onoff_subs, addr) ||
+	       sub_table_has(&onoff_srv_groups, addr);
+}
+
+/* Called for every access message once the models have handled it */
+static void access_msg_handled(uint32_t opcode, struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	/* The Configuration Server only accepts the local device key */
+	if (ctx->app_idx == BT_MESH_KEY_DEV_LOCAL) {
+		onoff_srv_groups_sync();
+	}
+}
+
+static const struct bt_mesh_elem elements[] = {
+	BT_MESH_ELEM(0, models, vnd_models),
+};
+
+static const struct bt_mesh_comp comp = {
+	.cid = BT_COMP_ID_LF,
+	.elem = elements,
+	.elem_count = ARRAY_SIZE(elements),
+};
+
+static void prov_reset(void)
+{
+	/* The stack cleared the model subscriptions */
+	onoff_srv_groups_sync();
+
+	bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+}
+
+static uint8_t dev_uuid[16];
+
+static const struct bt_mesh_prov prov = {
+	.uuid = dev_uuid,
+	.output_size = 4,
+	.output_actions = BT_MESH_DISPLAY_NUMBER,
+	.reset = prov_reset,
+};
+
+/* Acknowledged OnOff Set transactions.
+ *
+ * Every Generic OnOff Server that answers a Set is remembered as a peer of
+ * the destination the Set was sent to. When a new state is sent to a group,
+ * the peers of that group are expected to acknowledge it, and only the peers
+ * that haven't are retried, with unicast messages and an exponentially
+ * growing timeout. Status messages that don't answer a Set are ignored.
+ */
+enum onoff_txn_state {
+	TXN_FREE,
+	TXN_IDLE,
+	TXN_PENDING,
+};
+
+struct onoff_txn {
+	uint16_t addr;
+	/* Group the server answered a Set to, or its own address */
+	uint16_t dst;
+	uint8_t state;
+	uint8_t onoff;
+	/* TID of the Set, reused by its retries */
+	uint8_t tid;
+	uint8_t attempt;
+	int64_t deadline;
+};
+
+/* Group Sets sent within the first acknowledgment timeout. The servers
+ * answering them are learned as peers of the group.
+ */
+struct onoff_txn_group {
+	uint16_t dst;
+	uint8_t onoff;
+	int64_t until;
+};
+
+#define TXN_GROUPS_OPEN 4
+
+static struct onoff_txn txns[CONFIG_APP_ONOFF_PEER_MAX];
+static struct onoff_txn_group txn_groups[TXN_GROUPS_OPEN];
+static size_t txn_groups_next;
+static struct k_spinlock txn_lock;
+static struct k_work_delayable txn_work;
+
+static int onoff_tx_send_set(struct bt_mesh_msg_ctx *ctx, uint16_t addr,
+			     bool state, uint8_t tid);
+
+static int64_t onoff_txn_timeout(uint8_t attempt)
+{
+	return (int64_t)CONFIG_APP_ONOFF_RETRY_BASE_MS << attempt;
+}
+
+static struct onoff_txn *onoff_txn_find(uint16_t addr, uint16_t dst,
+					 bool alloc)
+{
+	struct onoff_txn *free_txn = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(txns); i++) {
+		if (txns[i].state == TXN_FREE) {
+			if (!free_txn) {
+				free_txn = &txns[i];
+			}
+		} else if (txns[i].addr == addr && txns[i].dst == dst) {
+			return &txns[i];
+		}
+	}
+
+	if (!alloc || !free_txn) {
+		return NULL;
+	}
+
+	free_txn->addr = addr;
+	free_txn->dst = dst;
+	free_txn->state = TXN_IDLE;
+
+	return free_txn;
+}
+
+static void onoff_txn_start_one(struct onoff_txn *txn, bool state,
+				uint8_t tid, int64_t now)
+{
+	txn->state = TXN_PENDING;
+	txn->onoff = state;
+	txn->tid = tid;
+	txn->attempt = 0;
+	txn->deadline = now + onoff_txn_timeout(0);
+}
+
+/** Open a group Set for learning the servers that answer it. */
+static void onoff_txn_group_open(uint16_t dst, bool state, int64_t now)
+{
+	struct onoff_txn_group *group = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(txn_groups); i++) {
+		if (txn_groups[i].dst == dst) {
+			group = &txn_groups[i];
+			break;
+		}
+	}
+
+	if (!group) {
+		group = &txn_groups[txn_groups_next];
+		txn_groups_next = (txn_groups_next + 1) %
+				  ARRAY_SIZE(txn_groups);
+	}
+
+	group->dst = dst;
+	group->onoff = state;
+	group->until = now + onoff_txn_timeout(0);
+}
+
+/** Expect an acknowledgment of @p state from @p dst, or from the known
+ *  peers of @p dst if it isn't a unicast address.
+ */
+static void onoff_txn_start(uint16_t dst, bool state, uint8_t tid)
+{
+	int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&txn_lock);
+
+	if (BT_MESH_ADDR_IS_UNICAST(dst)) {
+		struct onoff_txn *txn = onoff_txn_find(dst, dst, true);
+
+		if (txn) {
+			onoff_txn_start_one(txn, state, tid, now);
+		}
+	} else {
+		for (size_t i = 0; i < ARRAY_SIZE(txns); i++) {
+			if (txns[i].state != TXN_FREE && txns[i].dst == dst) {
+				onoff_txn_start_one(&txns[i], state, tid,
+						    now);
+			}
+		}
+
+		onoff_txn_group_open(dst, state, now);
+	}
+
+	k_spin_unlock(&txn_lock, key);
+
+	k_work_reschedule_for_queue(&app_workq, &txn_work,
+				    K_MSEC(onoff_txn_timeout(0)));
+}
+
+/** Learn @p addr as a peer of the open group Set it answers. Servers can't
+ *  be told apart when several open Sets have the same state.
+ */
+static void onoff_txn_learn(uint16_t addr, uint8_t target, int64_t now)
+{
+	const struct onoff_txn_group *match = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(txn_groups); i++) {
+		if (txn_groups[i].until <= now ||
+		    txn_groups[i].onoff != target) {
+			continue;
+		}
+
+		if (match) {
+			return;
+		}
+
+		match = &txn_groups[i];
+	}
+
+	if (match && !onoff_txn_find(addr, match->dst, true)) {
+		atomic_inc(&tx_stats.untracked);
+	}
+}
+
+/** Acknowledge the pending transactions of @p addr if the server reports
+ *  the state we sent as its target. Runs in the Bluetooth RX thread.
+ */
+static void onoff_txn_ack(uint16_t addr, uint8_t target)
+{
+	int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&txn_lock);
+	bool acked = false;
+
+	for (size_t i = 0; i < ARRAY_SIZE(txns); i++) {
+		struct onoff_txn *txn = &txns[i];
+
+		if (txn->state == TXN_PENDING && txn->addr == addr &&
+		    txn->onoff == target) {
+			txn->state = TXN_IDLE;
+			acked = true;
+		}
+	}
+
+	if (!acked) {
+		onoff_txn_learn(addr, target, now);
+	}
+
+	k_spin_unlock(&txn_lock, key);
+}
+
+/** Retry every pending transaction whose timeout has expired. */
+static void onoff_txn_retry(struct k_work *work)
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.app_idx = models[2].keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+	int64_t now = k_uptime_get();
+	int64_t next = INT64_MAX;
+
+	for (size_t i = 0; i < ARRAY_SIZE(txns); i++) {
+		k_spinlock_key_t key = k_spin_lock(&txn_lock);
+		struct onoff_txn *txn = &txns[i];
+		uint16_t addr = txn->addr;
+		bool state = txn->onoff;
+		uint8_t tid = txn->tid;
+		bool resend = false;
+
+		if (txn->state != TXN_PENDING) {
+			k_spin_unlock(&txn_lock, key);
+			continue;
+		}
+
+		if (txn->deadline <= now) {
+			if (txn->attempt >= CONFIG_APP_ONOFF_RETRY_MAX) {
+				printk("OnOff Set to 0x%04x not acknowledged\n",
+				       addr);
+				txn->state = TXN_IDLE;
+				k_spin_unlock(&txn_lock, key);
+				continue;
+			}
+
+			txn->attempt++;
+			txn->deadline = now + onoff_txn_timeout(txn->attempt);
+			resend = true;
+		}
+
+		next = MIN(next, txn->deadline);
+		k_spin_unlock(&txn_lock, key);
+
+		if (resend) {
+			onoff_tx_send_set(&ctx, addr, state, tid);
+		}
+	}
+
+	if (next != INT64_MAX) {
+		k_work_reschedule_for_queue(&app_workq, &txn_work,
+					    K_MSEC(next - now));
+	}
+}
+
+/* Pending OnOff Set state changes, coalesced per destination.
+ *
+ * When the stack runs out of buffers, or too many messages are in flight,
+ * pending changes stay in the queue and keep being coalesced until a send
+ * completes. Only if changes for more destinations than the queue can hold
+ * are made in the meantime, the oldest one is dropped.
+ */
+struct onoff_tx_entry {
+	uint16_t addr;
+	bool onoff;
+};
+
+static struct onoff_tx_entry tx_pending[CONFIG_APP_TX_BATCH_MAX];
+static size_t tx_pending_cnt;
+static struct k_work_delayable tx_work;
+static atomic_t tx_blocked;
+
+/* TID of the next OnOff Set. Starts at a random value, so a node that
+ * restarts doesn't repeat the TID of its last Set before the reboot.
+ */
+static uint8_t onoff_tid;
+
+/* Publications have no send callback. A published OnOff Set with
+ * retransmissions counts as one message in flight until the stack starts
+ * its last retransmission, or until the time the retransmissions should
+ * have taken, in case the Configuration Server changes the publication in
+ * the meantime.
+ */
+static atomic_t pub_inflight;
+static int64_t pub_inflight_end;
+
+static void onoff_tx_pub_done(void)
+{
+	if (atomic_cas(&pub_inflight, 1, 0)) {
+		atomic_dec(&tx_stats.inflight);
+		onoff_tx_unblock();
+	}
+}
+
+/** Check whether the last published OnOff Set is still being
+ *  retransmitted, and stop counting it once it should be done.
+ */
+static bool onoff_tx_pub_busy(void)
+{
+	if (!atomic_get(&pub_inflight)) {
+		return false;
+	}
+
+	if (k_uptime_get() < pub_inflight_end) {
+		return true;
+	}
+
+	onoff_tx_pub_done();
+
+	return false;
+}
+
+static void onoff_tx_unblock(void)
+{
+	if (atomic_cas(&tx_blocked, 1, 0)) {
+		k_work_reschedule_for_queue(&app_workq, &tx_work, K_NO_WAIT);
+	}
+}
+
+static void onoff_tx_block(void)
+{
+	atomic_set(&tx_blocked, 1);
+
+	/* Retry eventually, in case no send is in flight to unblock us */
+	k_work_schedule_for_queue(&app_workq, &tx_work,
+				  K_MSEC(CONFIG_APP_TX_COALESCE_MS));
+}
+
+static void onoff_tx_msg_fill(struct net_buf_simple *buf, bool state,
+			      uint8_t tid)
+{
+	uint32_t op = IS_ENABLED(CONFIG_APP_ONOFF_ACKED) ? OP_ONOFF_SET :
+							   OP_ONOFF_SET_UNACK;
+
+	bt_mesh_model_msg_init(buf, op);
+	net_buf_simple_add_u8(buf, state);
+
+	if (IS_ENABLED(CONFIG_APP_ONOFF_LEGACY_FORMAT)) {
+		uint16_t own_addr = bt_mesh_model_elem(&models[2])->rt->addr;
+
+		net_buf_simple_add_le16(buf, own_addr);
+	} else {
+		net_buf_simple_add_u8(buf, tid);
+	}
+}
+
+static int onoff_tx_send_set(struct bt_mesh_msg_ctx *ctx, uint16_t addr,
+			     bool state, uint8_t tid)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_ONOFF_SET, 3);
+	onoff_tx_msg_fill(&buf, state, tid);
+
+	ctx->addr = addr;
+
+	printk("Sending OnOff Set: %s to : 0x%04x\n", onoff_str[state], addr);
+
+	return model_send(&models[2], ctx, &buf);
+}
+
+/** Publish an OnOff Set with the publication parameters configured through
+ *  the Configuration Server.
+ *
+ *  Only publications with retransmissions are counted as in flight, until
+ *  the last retransmission. A single publication is handed to the stack
+ *  without a way to tell when it has been sent.
+ */
+static int onoff_tx_publish(bool state, uint8_t tid)
+{
+	const struct bt_mesh_model *model = &models[2];
+	uint8_t retransmit = model->pub->retransmit;
+	uint8_t count = BT_MESH_PUB_TRANSMIT_COUNT(retransmit);
+	uint32_t start;
+	int err;
+
+	onoff_tx_msg_fill(model->pub->msg, state, tid);
+
+	printk("Publishing OnOff Set: %s to : 0x%04x\n", onoff_str[state],
+	       model->pub->addr);
+
+	/* Count the publication before publishing, like model_send() does */
+	if (count) {
+		pub_inflight_end = k_uptime_get() + (count + 1) *
+				   BT_MESH_PUB_TRANSMIT_INT(retransmit);
+
+		if (atomic_cas(&pub_inflight, 0, 1)) {
+			atomic_inc(&tx_stats.inflight);
+		}
+	}
+
+	start = k_cycle_get_32();
+	err = bt_mesh_model_publish(model);
+	model_stats_tx(model->user_data, start, err);
+
+	if (err) {
+		onoff_tx_pub_done();
+	}
+
+	if (err == -ENOBUFS) {
+		atomic_inc(&tx_stats.nobufs);
+	} else if (err) {
+		printk("OnOff Set publish failed (err %d)\n", err);
+	} else {
+		boot_tx_mark();
+	}
+
+	return err;
+}
+
+static int onoff_tx_send_single(struct bt_mesh_msg_ctx *ctx,
+				const struct onoff_tx_entry *entry)
+{
+	bool publish = entry->addr == BT_MESH_ADDR_UNASSIGNED;
+	uint8_t tid = onoff_tid++;
+
+	if (IS_ENABLED(CONFIG_APP_ONOFF_ACKED)) {
+		onoff_txn_start(publish ? models[2].pub->addr : entry->addr,
+				entry->onoff, tid);
+	}
 
-#define OP_ONOFF_SET_UNACK BT_MESH_MODEL_OP_2(0x82, 0x03)
-#define OP_ONOFF_STATUS    BT_MESH_MODEL_OP_2(0x82, 0x04)
+	if (publish) {
+		return onoff_tx_publish(entry->onoff, tid);
+	}
 
-static uint16_t device_addr;
-static bool onoff;
+	return onoff_tx_send_set(ctx, entry->addr, entry->onoff, tid);
+}
 
-static const struct device *const led_dev = DEVICE_DT_GET(LED0_DEV);
-static const struct device *const button_dev = DEVICE_DT_GET(BUTTON0_DEV);
-static struct k_work *button_work;
+static int onoff_tx_send_batch(struct bt_mesh_msg_ctx *ctx)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_VND_BATCH_SET,
+				 CONFIG_APP_TX_BATCH_MAX * BATCH_ENTRY_LEN);
+	bt_mesh_model_msg_init(&buf, OP_VND_BATCH_SET);
 
-static void button_cb(const struct device *port, struct gpio_callback *cb,
-		      gpio_port_pins_t pins)
+	for (size_t i = 0; i < tx_pending_cnt; i++) {
+		uint16_t addr = tx_pending[i].addr;
+
+		if (addr == BT_MESH_ADDR_UNASSIGNED) {
+			addr = models[2].pub->addr;
+		}
+
+		net_buf_simple_add_le16(&buf, addr);
+		net_buf_simple_add_u8(&buf, tx_pending[i].onoff);
+	}
+
+	/* The targets may be spread over several groups */
+	ctx->addr = BT_MESH_ADDR_ALL_NODES;
+
+	printk("Sending batched OnOff Set: %u targets\n",
+	       (unsigned int)tx_pending_cnt);
+
+	return model_send(&vnd_models[0], ctx, &buf);
+}
+
+/** Remove the first @p cnt entries from the pending queue. */
+static void onoff_tx_consume(size_t cnt)
 {
-	k_work_submit(button_work);
+	tx_pending_cnt -= cnt;
+	memmove(&tx_pending[0], &tx_pending[cnt],
+		tx_pending_cnt * sizeof(tx_pending[0]));
+	atomic_set(&tx_stats.pending, tx_pending_cnt);
 }
 
-static int led_init(void)
+/** Send all pending state changes, in a single message if possible. */
+static void onoff_tx_flush(struct k_work *work)
 {
-	int err;
+	struct bt_mesh_msg_ctx ctx = {
+		.app_idx = models[2].keys[0], /* Use the bound key */
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+	bool publish = false;
+	size_t sent = 0;
+	int err = 0;
 
-	if (!device_is_ready(led_dev)) {
-		return -ENODEV;
+	if (!tx_pending_cnt) {
+		return;
 	}
 
-	err = gpio_pin_configure(led_dev, LED0_PIN,
-				 LED0_FLAGS | GPIO_OUTPUT_INACTIVE);
-	if (err) {
-		return err;
+	for (size_t i = 0; i < tx_pending_cnt; i++) {
+		publish |= tx_pending[i].addr == BT_MESH_ADDR_UNASSIGNED;
 	}
 
-	return 0;
+	/* The stack retransmits the last published Set from the publication
+	 * buffer, so it can't be refilled until it is done. The check also
+	 * stops counting a publication whose retransmissions were cut short.
+	 */
+	if ((onoff_tx_pub_busy() && publish) ||
+	    atomic_get(&tx_stats.inflight) >= CONFIG_APP_TX_INFLIGHT_MAX) {
+		onoff_tx_block();
+		return;
+	}
+
+	if (tx_pending_cnt == 1) {
+		err = onoff_tx_send_single(&ctx, &tx_pending[0]);
+		sent = err ? 0 : 1;
+	} else if (vnd_models[0].keys[0] == ctx.app_idx) {
+		err = onoff_tx_send_batch(&ctx);
+		sent = err ? 0 : tx_pending_cnt;
+	} else {
+		/* Peers can't be reached through the vendor model, fall back
+		 * to one Generic OnOff Set per destination.
+		 */
+		for (; sent < tx_pending_cnt && !err; sent++) {
+			err = onoff_tx_send_single(&ctx, &tx_pending[sent]);
+		}
+
+		if (err) {
+			sent--;
+		}
+	}
+
+	if (err == -ENOBUFS) {
+		onoff_tx_consume(sent);
+		onoff_tx_block();
+		return;
+	}
+
+	/* Other errors won't go away by retrying */
+	onoff_tx_consume(tx_pending_cnt);
 }
 
-static int button_init(struct k_work *button_pressed)
+/** Queue an OnOff state change for @p addr, or for the publication address
+ *  of the Generic OnOff Client if @p addr is BT_MESH_ADDR_UNASSIGNED.
+ *
+ *  The change is held for CONFIG_APP_TX_COALESCE_MS, and a later change to
+ *  the same destination within that window replaces it. Must be called from
+ *  the application work queue, which also runs the flush.
+ */
+static void onoff_tx_queue(uint16_t addr, bool state)
 {
-	int err;
+	for (size_t i = 0; i < tx_pending_cnt; i++) {
+		if (tx_pending[i].addr == addr) {
+			tx_pending[i].onoff = state;
+			goto schedule;
+		}
+	}
 
-	err = gpio_pin_configure(button_dev, BUTTON0_PIN,
-				 BUTTON0_FLAGS | GPIO_INPUT);
-	if (err) {
-		return err;
+	if (tx_pending_cnt == ARRAY_SIZE(tx_pending)) {
+		k_work_cancel_delayable(&tx_work);
+		onoff_tx_flush(NULL);
 	}
 
-	static struct gpio_callback gpio_cb;
+	if (tx_pending_cnt == ARRAY_SIZE(tx_pending)) {
+		printk("TX queue full, dropping OnOff Set to 0x%04x\n",
+		       tx_pending[0].addr);
+		atomic_inc(&tx_stats.dropped);
+		onoff_tx_consume(1);
+	}
 
-	err = gpio_pin_interrupt_configure(button_dev, BUTTON0_PIN,
-					   GPIO_INT_EDGE_TO_ACTIVE);
-	if (err) {
-		return err;
+	tx_pending[tx_pending_cnt].addr = addr;
+	tx_pending[tx_pending_cnt].onoff = state;
+	tx_pending_cnt++;
+	atomic_set(&tx_stats.pending, tx_pending_cnt);
+
+schedule:
+	/* Does not restart the window if a flush is already scheduled */
+	k_work_schedule_for_queue(&app_workq, &tx_work,
+				  K_MSEC(CONFIG_APP_TX_COALESCE_MS));
+}
+
+/** Queue an OnOff Set message from the Generic OnOff Client to its
+ *  publication address.
+ */
+static void button_pressed(struct k_work *work)
+{
+	model_stats_time_add(&workq_stats.button_wait, button_submit_cyc);
+
+	if (!bt_mesh_is_provisioned()) {
+		return;
 	}
 
-	button_work = button_pressed;
+	if (models[2].keys[0] == BT_MESH_KEY_UNUSED) {
+		printk("The Generic OnOff Client must be bound to a key before "
+		       "sending.\n");
+		return;
+	}
 
-	gpio_init_callback(&gpio_cb, button_cb, BIT(BUTTON0_PIN));
-	gpio_add_callback(button_dev, &gpio_cb);
+	if (models[2].pub->addr == BT_MESH_ADDR_UNASSIGNED) {
+		printk("The Generic OnOff Client must be configured to publish "
+		       "before sending.\n");
+		return;
+	}
 
-	return 0;
+	onoff = !onoff;
+
+	app_state_set(APP_STATE_ONOFF, onoff);
+	app_state_set(APP_STATE_PRESSES, atomic_get(&button_stats.presses));
+
+	onoff_tx_queue(BT_MESH_ADDR_UNASSIGNED, onoff);
 }
 
-int board_init(struct k_work *button_pressed)
+/* State changes requested from outside the application work queue, such as
+ * the shell, for specific destinations. They are moved to the pending queue
+ * by the work queue, so changes requested together end up in the same
+ * coalescing window and are sent in a single Batched Set.
+ */
+K_MSGQ_DEFINE(tx_requests, sizeof(struct onoff_tx_entry),
+	      CONFIG_APP_TX_BATCH_MAX, 4);
+
+static void onoff_tx_requests_drain(struct k_work *work)
 {
-	int err;
+	struct onoff_tx_entry entry;
 
-	err = led_init();
-	if (err) {
-		return err;
+	while (!k_msgq_get(&tx_requests, &entry, K_NO_WAIT)) {
+		onoff_tx_queue(entry.addr, entry.onoff);
 	}
-
-	return button_init(button_pressed);
 }
 
-static const char *const onoff_str[] = { "off", "on" };
+static K_WORK_DEFINE(tx_request_work, onoff_tx_requests_drain);
 
-static int gen_onoff_set(const struct bt_mesh_model *model,
-			       struct bt_mesh_msg_ctx *ctx,
-			       struct net_buf_simple *buf)
+/** Request an OnOff Set to @p addr from any thread.
+ *
+ *  @return 0 on success, -EINVAL if @p addr is unassigned, or -ENOMEM if
+ *          too many requests are waiting for the work queue.
+ */
+static int onoff_tx_request(uint16_t addr, bool state)
 {
-	uint8_t val = net_buf_simple_pull_u8(buf);
-	uint16_t addr = net_buf_simple_pull_le16(buf);
+	struct onoff_tx_entry entry = {
+		.addr = addr,
+		.onoff = state,
+	};
+	int err;
+
+	if (addr == BT_MESH_ADDR_UNASSIGNED) {
+		return -EINVAL;
+	}
 
-	if (addr != device_addr){
-		printk("set: %s from : 0x%04x\n", onoff_str[val], addr);
-		gpio_pin_set(led_dev, LED0_PIN, val);
+	err = k_msgq_put(&tx_requests, &entry, K_NO_WAIT);
+	if (err) {
+		return -ENOMEM;
 	}
 
+	k_work_submit_to_queue(&app_workq, &tx_request_work);
+
 	return 0;
 }
 
-static const struct bt_mesh_model_op gen_onoff_srv_op[] = {
-	{ OP_ONOFF_SET_UNACK, BT_MESH_LEN_MIN(2),   gen_onoff_set },
-	BT_MESH_MODEL_OP_END,
-};
+#if defined(CONFIG_SHELL)
+static int cmd_onoff_set(const struct shell *sh, size_t argc, char **argv)
+{
+	if (!bt_mesh_is_provisioned() ||
+	    models[2].keys[0] == BT_MESH_KEY_UNUSED) {
+		shell_error(sh, "The Generic OnOff Client isn't configured");
+		return -EAGAIN;
+	}
 
-/* Generic OnOff Client */
+	if (argc % 2 == 0) {
+		shell_error(sh, "Expected <addr> <on|off> pairs");
+		return -EINVAL;
+	}
 
-static int gen_onoff_status(const struct bt_mesh_model *model,
-			    struct bt_mesh_msg_ctx *ctx,
-			    struct net_buf_simple *buf)
-{
-	uint8_t present = net_buf_simple_pull_u8(buf);
+	for (size_t i = 1; i < argc; i += 2) {
+		int err = 0;
+		uint16_t addr = shell_strtoul(argv[i], 16, &err);
+		bool state = shell_strtobool(argv[i + 1], 0, &err);
+
+		if (!err) {
+			err = onoff_tx_request(addr, state);
+		}
 
-	printk("OnOff status: %s\n", onoff_str[present]);
+		if (err) {
+			shell_error(sh, "Failed to queue %s %s (err %d)",
+				    argv[i], argv[i + 1], err);
+			return err;
+		}
+	}
 
 	return 0;
 }
 
-static const struct bt_mesh_model_op gen_onoff_cli_op[] = {
-	{OP_ONOFF_STATUS, BT_MESH_LEN_MIN(1), gen_onoff_status},
-	BT_MESH_MODEL_OP_END,
-};
+SHELL_STATIC_SUBCMD_SET_CREATE(onoff_cmds,
+	SHELL_CMD_ARG(set, NULL,
+		      "Send OnOff Sets <addr> <on|off> [<addr> <on|off> ...]",
+		      cmd_onoff_set, 3, 2 * (CONFIG_APP_TX_BATCH_MAX - 1)),
+	SHELL_SUBCMD_SET_END
+);
 
-/* This application only needs one element to contain its models */
-static const struct bt_mesh_model models[] = {
-	BT_MESH_MODEL_CFG_SRV,
-	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_ONOFF_SRV, gen_onoff_srv_op, NULL,
-		      NULL),
-	BT_MESH_MODEL(BT_MESH_MODEL_ID_GEN_ONOFF_CLI, gen_onoff_cli_op, NULL,
-		      NULL),
-};
+SHELL_CMD_REGISTER(onoff, &onoff_cmds, "Generic OnOff Client", NULL);
+#endif /* CONFIG_SHELL */
 
-static const struct bt_mesh_elem elements[] = {
-	BT_MESH_ELEM(0, models, BT_MESH_MODEL_NONE),
-};
+/** Bring the node back to the state it had before a reboot. */
+static void app_state_restore(void)
+{
+	uint16_t scene = app_state_get(APP_STATE_SCENE);
+	uint16_t lightness;
 
-static const struct bt_mesh_comp comp = {
-	.cid = BT_COMP_ID_LF,
-	.elem = elements,
-	.elem_count = ARRAY_SIZE(elements),
-};
+	onoff = app_state_get(APP_STATE_ONOFF);
+	atomic_add(&button_stats.presses, app_state_get(APP_STATE_PRESSES));
 
-static void prov_reset(void)
-{
-	bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+	/* Recalling makes the stored scene current again, and its lightness
+	 * is the one the light was left at.
+	 */
+	if (scene) {
+		scene_recall(scene, &lightness);
+	}
+
+	light_restore(app_state_get(APP_STATE_LIGHTNESS),
+		      app_state_get(APP_STATE_LIGHTNESS_LAST));
 }
 
-static uint8_t dev_uuid[16];
+/* Periodic OnOff Status publication.
+ *
+ * Nodes that lose power together boot together, and would publish in
+ * lockstep if they all used the same period. The first publication is sent
+ * at a random time within the first period, and every interval after that
+ * is randomized by up to CONFIG_APP_ONOFF_STATUS_JITTER_PCT percent of the
+ * period, so the nodes drift apart instead of staying in sync.
+ */
+static struct k_work_delayable status_pub_work;
 
-static const struct bt_mesh_prov prov = {
-	.uuid = dev_uuid,
-	.output_size = 4,
-	.output_actions = BT_MESH_DISPLAY_NUMBER,
-	.reset = prov_reset,
-};
+static uint32_t onoff_status_pub_interval(void)
+{
+	uint32_t period = CONFIG_APP_ONOFF_STATUS_PERIOD_S * MSEC_PER_SEC;
+	uint32_t jitter = period / 100 * CONFIG_APP_ONOFF_STATUS_JITTER_PCT;
 
-/** Send an OnOff Set message from the Generic OnOff Client to all nodes. */
-static void button_pressed(struct k_work *work)
+	return period - jitter + sys_rand32_get() % (2 * jitter + 1);
+}
+
+static void onoff_status_publish(struct k_work *work)
 {
-	if (!bt_mesh_is_provisioned()) {
+	const struct bt_mesh_model *model = &models[1];
+	uint32_t start;
+	int err;
+
+	k_work_schedule_for_queue(&app_workq, &status_pub_work,
+				  K_MSEC(onoff_status_pub_interval()));
+
+	/* A publish period set through the Configuration Server is handled
+	 * by the stack instead
+	 */
+	if (!bt_mesh_is_provisioned() || model->pub->period ||
+	    model->pub->addr == BT_MESH_ADDR_UNASSIGNED) {
 		return;
 	}
 
-	struct bt_mesh_msg_ctx ctx = {
-		.app_idx = models[2].keys[0], /* Use the bound key */
-		.addr = BT_MESH_ADDR_ALL_NODES,
-		.send_ttl = BT_MESH_TTL_DEFAULT,
-	};
+	onoff_status_fill(model->pub->msg);
 
-	if (ctx.app_idx == BT_MESH_KEY_UNUSED) {
-		printk("The Generic OnOff Client must be bound to a key before "
-		       "sending.\n");
+	start = k_cycle_get_32();
+	err = bt_mesh_model_publish(model);
+	model_stats_tx(model->user_data, start, err);
+
+	if (err == -ENOBUFS) {
+		atomic_inc(&tx_stats.nobufs);
+	} else if (err) {
+		printk("OnOff Status publish failed (err %d)\n", err);
+	}
+}
+
+static void onoff_status_pub_start(void)
+{
+	if (!CONFIG_APP_ONOFF_STATUS_PERIOD_S) {
 		return;
 	}
 
-	onoff = !onoff;
+	k_work_init_delayable(&status_pub_work, onoff_status_publish);
+	k_work_schedule_for_queue(&app_workq, &status_pub_work,
+				  K_MSEC(sys_rand32_get() %
+					 (CONFIG_APP_ONOFF_STATUS_PERIOD_S *
+					  MSEC_PER_SEC)));
+}
+
+/* Self-provisioning address allocation.
+ *
+ * The unicast address is a hash of the full device UUID. Before committing to
+ * it, the node joins with a temporary address and sends a Generic OnOff Get to
+ * the candidate. If anyone answers, the address is taken and another candidate
+ * is derived from the UUID and the attempt number.
+ */
+static struct {
+	uint16_t candidate;
+	uint8_t attempt;
+	bool taken;
+	struct k_work_delayable timeout;
+} addr_probe;
+
+static uint16_t addr_from_uuid(uint8_t seed)
+{
+	/* 32-bit FNV-1a over the UUID and the seed */
+	uint32_t hash = 2166136261u;
+	uint16_t addr;
 
-	BT_MESH_MODEL_BUF_DEFINE(buf, OP_ONOFF_SET_UNACK, 3);
-	bt_mesh_model_msg_init(&buf, OP_ONOFF_SET_UNACK);
-	net_buf_simple_add_u8(&buf, onoff);
-	net_buf_simple_add_le16(&buf, device_addr);
+	for (size_t i = 0; i < sizeof(dev_uuid); i++) {
+		hash = (hash ^ dev_uuid[i]) * 16777619u;
+	}
 
-	printk("Sending OnOff Set: %s\n", onoff_str[onoff]);
+	hash = (hash ^ seed) * 16777619u;
 
-	bt_mesh_model_send(&models[2], &ctx, &buf, NULL, NULL);  
+	addr = (hash ^ (hash >> 15)) & BIT_MASK(15);
 
-	return;
+	return addr == BT_MESH_ADDR_UNASSIGNED ? 1 : addr;
 }
 
-static void provision(){
+/** Apply the self-provisioning model configuration.
+ *
+ *  Only touches the models in RAM, so it is cheap enough to run on every boot
+ *  and never writes to flash. Bindings the Configuration Server has already
+ *  set up are left alone.
+ */
+static void self_configure(void)
+{
+	/* Models must be bound to an app key to send and receive messages with
+	 * it:
+	 */
+	for (size_t i = 1; i < ARRAY_SIZE(models); i++) {
+		if (models[i].keys[0] == BT_MESH_KEY_UNUSED) {
+			models[i].keys[0] = 0;
+		}
+	}
+
+	if (vnd_models[0].keys[0] == BT_MESH_KEY_UNUSED) {
+		vnd_models[0].keys[0] = 0;
+	}
+
+	/* Publish button presses, and the server state, to a group all
+	 * servers subscribe to, unless the Configuration Server has already
+	 * been given other settings. Only button presses are retransmitted,
+	 * the server state is published again periodically.
+	 */
+	for (size_t i = 1; i <= 2; i++) {
+		if (models[i].pub->addr == BT_MESH_ADDR_UNASSIGNED) {
+			models[i].pub->addr = CONFIG_APP_GROUP_ADDR;
+			models[i].pub->key = 0;
+			models[i].pub->ttl = BT_MESH_TTL_DEFAULT;
+			models[i].pub->retransmit =
+				i == 2 ? ONOFF_CLI_RETRANSMIT : 0;
+		}
+	}
+
+	/* Skip the Configuration Server, it can't subscribe */
+	for (size_t i = 1; i < ARRAY_SIZE(models); i++) {
+		if (i != 2 && models[i].groups_cnt &&
+		    models[i].groups[0] == BT_MESH_ADDR_UNASSIGNED) {
+			models[i].groups[0] = CONFIG_APP_GROUP_ADDR;
+		}
+	}
+
+	/* The subscriptions were restored from settings or set above */
+	onoff_srv_groups_sync();
+}
+
+static int self_provision(uint16_t addr)
+{
 	static uint8_t dev_key[16];
 	static uint8_t net_key[16];
 	static uint8_t app_key[16];
-	
-	int err;
 
-	device_addr = sys_get_le16(&dev_uuid[0]) & BIT_MASK(15);
+	int err;
 
-	printk("Self-provisioning with address 0x%x\n", device_addr);
-	err = bt_mesh_provision(net_key, 0, 0, 0, device_addr, dev_key);
+	err = bt_mesh_provision(net_key, 0, 0, 0, addr, dev_key);
 	if (err) {
-		bt_mesh_prov_disable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
-		bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+		printk("Provisioning failed (err: %d)\n", err);
+		return err;
 	}
 
 	/* Add an application key to both Generic OnOff models: */
 	err = bt_mesh_app_key_add(0, 0, app_key);
 	if (err) {
 		printk("App key add failed (err: %d)\n", err);
+		return err;
+	}
+
+	self_configure();
+
+	return 0;
+}
+
+static void addr_probe_send(void)
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.app_idx = models[2].keys[0],
+		.addr = addr_probe.candidate,
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+
+	BT_MESH_MODEL_BUF_DEFINE(buf, OP_ONOFF_GET, 0);
+	bt_mesh_model_msg_init(&buf, OP_ONOFF_GET);
+
+	addr_probe.taken = false;
+
+	printk("Probing address 0x%04x\n", addr_probe.candidate);
+
+	model_send(&models[2], &ctx, &buf);
+
+	k_work_reschedule_for_queue(&app_workq, &addr_probe.timeout,
+				    K_MSEC(CONFIG_APP_ADDR_PROBE_TIMEOUT_MS));
+}
+
+static void addr_probe_rx(uint16_t addr)
+{
+	if (addr_probe.candidate != BT_MESH_ADDR_UNASSIGNED &&
+	    addr == addr_probe.candidate) {
+		addr_probe.taken = true;
+	}
+}
+
+static void addr_probe_done(struct k_work *work)
+{
+	if (addr_probe.taken &&
+	    addr_probe.attempt + 1 < CONFIG_APP_ADDR_ALLOC_ATTEMPTS) {
+		printk("Address 0x%04x is taken\n", addr_probe.candidate);
+		addr_probe.candidate = addr_from_uuid(++addr_probe.attempt);
+		addr_probe_send();
 		return;
 	}
 
-	/* Models must be bound to an app key to send and receive messages with
-	 * it:
+	if (addr_probe.taken) {
+		printk("No free address found, using 0x%04x\n",
+		       addr_probe.candidate);
+	}
+
+	/* Leave the temporary address and join for real */
+	device_addr = addr_probe.candidate;
+	addr_probe.candidate = BT_MESH_ADDR_UNASSIGNED;
+	bt_mesh_reset();
+
+	printk("Self-provisioning with address 0x%x\n", device_addr);
+	if (!self_provision(device_addr)) {
+		printk("Provisioned and configured!\n");
+
+		/* Written after the delay of the state writer, which leaves
+		 * the stack time to store the new credentials first. If it
+		 * doesn't, the next boot clears the marker.
+		 */
+		app_state_set(APP_STATE_PROBE_ADDR, BT_MESH_ADDR_UNASSIGNED);
+	}
+}
+
+static void provision(){
+	uint16_t temp_addr;
+
+	addr_probe.attempt = 0;
+	addr_probe.candidate = addr_from_uuid(0);
+
+	/* The temporary address is derived with a seed that is never used for
+	 * candidates, and is only used for the duration of the probe.
+	 */
+	temp_addr = addr_from_uuid(UINT8_MAX);
+	if (temp_addr == addr_probe.candidate) {
+		temp_addr ^= 1;
+	}
+
+	/* The stack stores the temporary credentials like any others. Record
+	 * that the probe is unfinished before they can reach persistent
+	 * storage, so a node rebooted during the probe doesn't keep the
+	 * temporary address.
 	 */
-	models[1].keys[0] = 0;
-	models[2].keys[0] = 0;
+	app_state_set(APP_STATE_PROBE_ADDR, temp_addr);
+	app_state_flush();
+
+	if (self_provision(temp_addr)) {
+		return;
+	}
 
-	printk("Provisioned and configured!\n");
+	addr_probe_send();
 }
 
 static void bt_ready(int err)
 {
+	uint32_t probe_addr;
+
 	if (err) {
 		printk("Bluetooth init failed (err %d)\n", err);
 		return;
@@ -252,11 +2233,53 @@ static void bt_ready(int err)
 		return;
 	}
 
+	bt_mesh_msg_cb_set(access_msg_handled);
+
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
 		settings_load();
 	}
 
-	/* This will be a no-op if settings_load() loaded provisioning info */
+	app_state_restore();
+	dup_density_init();
+
+	probe_addr = app_state_get(APP_STATE_PROBE_ADDR);
+
+	if (bt_mesh_is_provisioned() && probe_addr) {
+		if (elements[0].rt->addr == probe_addr) {
+			printk("Address probe was interrupted, "
+			       "starting over\n");
+			bt_mesh_reset();
+		} else {
+			/* The probe finished, but the marker wasn't cleared */
+			app_state_set(APP_STATE_PROBE_ADDR,
+				      BT_MESH_ADDR_UNASSIGNED);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_APP_RELAY_ADAPTIVE)) {
+		relay_policy_init(&app_workq);
+	}
+
+	if (IS_ENABLED(CONFIG_BT_MESH_LOW_POWER)) {
+		lpn_energy_init(&app_workq);
+	}
+
+	onoff_status_pub_start();
+
+	if (bt_mesh_is_provisioned()) {
+		/* The keys and the address allocated before the last reboot
+		 * were restored from settings, so there is nothing to provision
+		 * or store. Only the model configuration that is never stored
+		 * has to be applied again.
+		 */
+		device_addr = elements[0].rt->addr;
+		self_configure();
+
+		printk("Mesh initialized with address 0x%04x in %u ms\n",
+		       device_addr, k_uptime_get_32());
+		return;
+	}
+
 	bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
 
 	printk("Mesh initialized\n");
@@ -275,11 +2298,27 @@ int main(void)
 	}
 
 	if (err < 0) {
-		dev_uuid[0] = 0xdd;
-		dev_uuid[1] = 0xdd;
+		/* Without a device ID, nodes would all share the same UUID and
+		 * start out with the same address.
+		 */
+		sys_rand_get(dev_uuid, sizeof(dev_uuid));
 	}
 
+	k_work_queue_start(&app_workq, app_workq_stack,
+			   K_THREAD_STACK_SIZEOF(app_workq_stack),
+			   CONFIG_APP_WORKQ_PRIORITY, NULL);
+	k_thread_name_set(&app_workq.thread, "app_workq");
+
 	k_work_init(&button_work, button_pressed);
+	k_work_init_delayable(&tx_work, onoff_tx_flush);
+	k_work_init_delayable(&txn_work, onoff_txn_retry);
+	k_work_init_delayable(&addr_probe.timeout, addr_probe_done);
+	onoff_tid = sys_rand32_get();
+
+	/* Count the publication retransmissions, whatever the Configuration
+	 * Server sets them to
+	 */
+	gen_onoff_cli_pub.retr_update = 1;
 
 	err = board_init(&button_work);
 	if (err) {
@@ -287,10 +2326,30 @@ int main(void)
 		return 0;
 	}
 
+	/* The fuzzing build feeds libFuzzer inputs to the models of an
+	 * unprovisioned node, without the radio
+	 */
+	if (IS_ENABLED(CONFIG_ARCH_POSIX_LIBFUZZER)) {
+		err = bt_mesh_init(&prov, &comp);
+		if (err) {
+			printk("Initializing mesh failed (err %d)\n", err);
+			return 0;
+		}
+
+		self_configure();
+		fuzz_run(&elements[0]);
+	}
+
 	/* Initialize the Bluetooth Subsystem */
 	err = bt_enable(bt_ready);
 	if (err) {
 		printk("Bluetooth init failed (err %d)\n", err);
+		return 0;
+	}
+
+	if (IS_ENABLED(CONFIG_APP_BENCH)) {
+		bench_start(&app_workq, &button_work);
 	}
+
 	return 0;
 }
@@ -0,0 +1,222 @@
+/* model_stats.c - Per-model message statistics */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "model_stats.h"
+
+struct model_stats model_stats[MODEL_STATS_COUNT] = {
+	[MODEL_STATS_ONOFF_SRV] = { .name = "onoff_srv" },
+	[MODEL_STATS_ONOFF_CLI] = { .name = "onoff_cli" },
+	[MODEL_STATS_VND] = { .name = "vnd" },
+	[MODEL_STATS_LEVEL_SRV] = { .name = "level_srv" },
+	[MODEL_STATS_LIGHTNESS_SRV] = { .name = "light_srv" },
+	[MODEL_STATS_SCENE_SRV] = { .name = "scene_srv" },
+	[MODEL_STATS_SCENE_SETUP_SRV] = { .name = "scene_setup" },
+};
+
+struct tx_stats tx_stats;
+struct workq_stats workq_stats;
+struct button_stats button_stats;
+struct flash_stats flash_stats;
+struct density_stats density_stats;
+struct tid_stats tid_stats;
+
+/* Timing blocks are updated without locking. They're normally written by a
+ * single thread, and a sample lost to a concurrent update or a slightly
+ * inconsistent snapshot in a reader is acceptable for statistics.
+ */
+void model_stats_time_add(struct model_stats_time *time, uint32_t start)
+{
+	uint32_t cyc = k_cycle_get_32() - start;
+
+	time->last = cyc;
+	time->max = MAX(time->max, cyc);
+	time->total += cyc;
+	time->count++;
+}
+
+static uint32_t time_avg_us(const struct model_stats_time *time)
+{
+	if (!time->count) {
+		return 0;
+	}
+
+	return k_cyc_to_us_floor32(time->total / time->count);
+}
+
+void model_stats_rx(struct model_stats *stats, uint32_t start)
+{
+	atomic_inc(&stats->rx);
+	model_stats_time_add(&stats->handler, start);
+}
+
+void model_stats_rejected(struct model_stats *stats, uint32_t start)
+{
+	atomic_inc(&stats->rejected);
+	model_stats_rx(stats, start);
+}
+
+void model_stats_tx(struct model_stats *stats, uint32_t start, int err)
+{
+	atomic_inc(&stats->tx);
+	if (err) {
+		atomic_inc(&stats->tx_err);
+	}
+
+	model_stats_time_add(&stats->send, start);
+}
+
+static void time_encode(const struct model_stats_time *time,
+			struct net_buf_simple *buf)
+{
+	net_buf_simple_add_le32(buf, k_cyc_to_us_floor32(time->last));
+	net_buf_simple_add_le32(buf, time_avg_us(time));
+	net_buf_simple_add_le32(buf, k_cyc_to_us_floor32(time->max));
+}
+
+void model_stats_encode(const struct model_stats *stats,
+			struct net_buf_simple *buf)
+{
+	net_buf_simple_add_le32(buf, atomic_get(&stats->rx));
+	net_buf_simple_add_le32(buf, atomic_get(&stats->tx));
+	net_buf_simple_add_le32(buf, atomic_get(&stats->tx_err));
+	time_encode(&stats->handler, buf);
+	time_encode(&stats->send, buf);
+	net_buf_simple_add_le32(buf, atomic_get(&stats->rejected));
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_stats_models(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "%-10s %8s %8s %8s %8s %24s %24s", "model", "rx",
+		    "rejected", "tx", "tx err", "handler last/avg/max us",
+		    "send last/avg/max us");
+
+	for (size_t i = 0; i < ARRAY_SIZE(model_stats); i++) {
+		const struct model_stats *stats = &model_stats[i];
+
+		shell_print(sh, "%-10s %8u %8u %8u %8u %8u/%7u/%7u %8u/%7u/%7u",
+			    stats->name, (uint32_t)atomic_get(&stats->rx),
+			    (uint32_t)atomic_get(&stats->rejected),
+			    (uint32_t)atomic_get(&stats->tx),
+			    (uint32_t)atomic_get(&stats->tx_err),
+			    k_cyc_to_us_floor32(stats->handler.last),
+			    time_avg_us(&stats->handler),
+			    k_cyc_to_us_floor32(stats->handler.max),
+			    k_cyc_to_us_floor32(stats->send.last),
+			    time_avg_us(&stats->send),
+			    k_cyc_to_us_floor32(stats->send.max));
+	}
+
+	return 0;
+}
+
+static int cmd_stats_tx(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "in flight: %u (max %u)",
+		    (uint32_t)atomic_get(&tx_stats.inflight),
+		    (uint32_t)atomic_get(&tx_stats.inflight_max));
+	shell_print(sh, "pending:   %u",
+		    (uint32_t)atomic_get(&tx_stats.pending));
+	shell_print(sh, "no bufs:   %u",
+		    (uint32_t)atomic_get(&tx_stats.nobufs));
+	shell_print(sh, "dropped:   %u",
+		    (uint32_t)atomic_get(&tx_stats.dropped));
+	shell_print(sh, "pub retransmits: %u",
+		    (uint32_t)atomic_get(&tx_stats.pub_retransmits));
+	shell_print(sh, "untracked peer statuses: %u",
+		    (uint32_t)atomic_get(&tx_stats.untracked));
+
+	return 0;
+}
+
+static int cmd_stats_workq(const struct shell *sh, size_t argc, char **argv)
+{
+	const struct model_stats_time *wait = &workq_stats.button_wait;
+
+	shell_print(sh, "button wait last/avg/max us: %u/%u/%u (%u presses)",
+		    k_cyc_to_us_floor32(wait->last), time_avg_us(wait),
+		    k_cyc_to_us_floor32(wait->max), wait->count);
+
+	return 0;
+}
+
+static int cmd_stats_button(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "presses:      %u",
+		    (uint32_t)atomic_get(&button_stats.presses));
+	shell_print(sh, "bounces:      %u",
+		    (uint32_t)atomic_get(&button_stats.bounces));
+	shell_print(sh, "rate limited: %u",
+		    (uint32_t)atomic_get(&button_stats.rate_limited));
+
+	return 0;
+}
+
+static int cmd_stats_flash(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "changes: %u",
+		    (uint32_t)atomic_get(&flash_stats.changes));
+	shell_print(sh, "writes:  %u",
+		    (uint32_t)atomic_get(&flash_stats.writes));
+	shell_print(sh, "bytes:   %u",
+		    (uint32_t)atomic_get(&flash_stats.bytes));
+	shell_print(sh, "failed:  %u",
+		    (uint32_t)atomic_get(&flash_stats.failed));
+
+	return 0;
+}
+
+static int cmd_stats_density(const struct shell *sh, size_t argc,
+			     char **argv)
+{
+	uint32_t pdus = atomic_get(&density_stats.pdus);
+	uint32_t dups = atomic_get(&density_stats.dups);
+
+	shell_print(sh, "pdus:      %u", pdus);
+	shell_print(sh, "dups:      %u (%u%%)", dups,
+		    pdus ? dups * 100 / pdus : 0);
+	shell_print(sh, "evictions: %u",
+		    (uint32_t)atomic_get(&density_stats.evictions));
+	shell_print(sh, "missed:    %u",
+		    (uint32_t)atomic_get(&density_stats.missed));
+
+	return 0;
+}
+
+static int cmd_stats_tid(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "transactions: %u",
+		    (uint32_t)atomic_get(&tid_stats.transactions));
+	shell_print(sh, "replays:      %u",
+		    (uint32_t)atomic_get(&tid_stats.replays));
+	shell_print(sh, "evictions:    %u",
+		    (uint32_t)atomic_get(&tid_stats.evictions));
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_cmds,
+	SHELL_CMD(button, NULL, "Print button statistics", cmd_stats_button),
+	SHELL_CMD(density, NULL, "Print duplicate density statistics",
+		  cmd_stats_density),
+	SHELL_CMD(flash, NULL, "Print persistent state write statistics",
+		  cmd_stats_flash),
+	SHELL_CMD(models, NULL, "Print per-model message statistics",
+		  cmd_stats_models),
+	SHELL_CMD(tid, NULL, "Print OnOff Set transaction statistics",
+		  cmd_stats_tid),
+	SHELL_CMD(tx, NULL, "Print transmit queue statistics", cmd_stats_tx),
+	SHELL_CMD(workq, NULL, "Print application work queue statistics",
+		  cmd_stats_workq),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(stats, &stats_cmds, "Application statistics", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,173 @@
+/* model_stats.h - Per-model message statistics */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MODEL_STATS_H__
+#define MODEL_STATS_H__
+
+#include <zephyr/kernel.h>
+
+struct net_buf_simple;
+
+/** Models that statistics are kept for */
+enum model_stats_id {
+	MODEL_STATS_ONOFF_SRV,
+	MODEL_STATS_ONOFF_CLI,
+	MODEL_STATS_VND,
+	MODEL_STATS_LEVEL_SRV,
+	MODEL_STATS_LIGHTNESS_SRV,
+	MODEL_STATS_SCENE_SRV,
+	MODEL_STATS_SCENE_SETUP_SRV,
+
+	MODEL_STATS_COUNT,
+};
+
+/** Timing of an operation, in hardware cycles */
+struct model_stats_time {
+	uint32_t last;
+	uint32_t max;
+	uint64_t total;
+	uint32_t count;
+};
+
+struct model_stats {
+	const char *name;
+	atomic_t rx;
+	atomic_t tx;
+	atomic_t tx_err;
+	/* Received messages dropped for an invalid payload */
+	atomic_t rejected;
+	/* Time spent in the message handlers */
+	struct model_stats_time handler;
+	/* Time spent in bt_mesh_model_send() */
+	struct model_stats_time send;
+};
+
+/** Statistics of each model, used as the model user data */
+extern struct model_stats model_stats[MODEL_STATS_COUNT];
+
+/** Transmit queue statistics, shared by all models */
+struct tx_stats {
+	/* Messages passed to the stack and not sent yet */
+	atomic_t inflight;
+	atomic_t inflight_max;
+	/* OnOff state changes waiting to be sent */
+	atomic_t pending;
+	/* Sends that failed for lack of buffers */
+	atomic_t nobufs;
+	/* State changes dropped because the pending queue was full */
+	atomic_t dropped;
+	/* Publication retransmissions sent by the stack */
+	atomic_t pub_retransmits;
+	/* OnOff Statuses from servers beyond CONFIG_APP_ONOFF_PEER_MAX */
+	atomic_t untracked;
+};
+
+extern struct tx_stats tx_stats;
+
+/** Application work queue statistics */
+struct workq_stats {
+	/* Time from a button press until its work item runs */
+	struct model_stats_time button_wait;
+};
+
+extern struct workq_stats workq_stats;
+
+/** Button statistics */
+struct button_stats {
+	/* Presses passed on to the application work queue */
+	atomic_t presses;
+	/* Edges suppressed by the debounce timer */
+	atomic_t bounces;
+	/* Presses suppressed for following the previous one too closely */
+	atomic_t rate_limited;
+};
+
+extern struct button_stats button_stats;
+
+/** Persistent application state statistics */
+struct flash_stats {
+	/* State changes that were due to be stored */
+	atomic_t changes;
+	/* Settings entries written */
+	atomic_t writes;
+	/* Bytes of state written, not counting the settings overhead */
+	atomic_t bytes;
+	/* Settings entries that failed to be written */
+	atomic_t failed;
+};
+
+extern struct flash_stats flash_stats;
+
+/** Duplicate density statistics */
+struct density_stats {
+	/* Network PDUs heard */
+	atomic_t pdus;
+	/* PDUs heard again while still remembered */
+	atomic_t dups;
+	/* Entries replaced to make room for a new PDU */
+	atomic_t evictions;
+	/* Duplicates heard after their entry was replaced, so counted as new
+	 * PDUs. When many are, the density is underestimated.
+	 */
+	atomic_t missed;
+};
+
+extern struct density_stats density_stats;
+
+/** Generic OnOff Server transaction statistics */
+struct tid_stats {
+	/* OnOff Sets with a TID that started a new transaction */
+	atomic_t transactions;
+	/* Retransmissions of a transaction, which weren't applied again */
+	atomic_t replays;
+	/* Sources dropped from the cache within the transaction window */
+	atomic_t evictions;
+};
+
+extern struct tid_stats tid_stats;
+
+/** Add a sample to a timing block.
+ *
+ *  @param time  Timing block.
+ *  @param start Cycle count at the start of the timed operation.
+ */
+void model_stats_time_add(struct model_stats_time *time, uint32_t start);
+
+/** Account a received message.
+ *
+ *  @param stats Statistics of the receiving model.
+ *  @param start Cycle count when the message handler was entered.
+ */
+void model_stats_rx(struct model_stats *stats, uint32_t start);
+
+/** Account a received message that was dropped for an invalid payload.
+ *
+ *  @param stats Statistics of the receiving model.
+ *  @param start Cycle count when the message handler was entered.
+ */
+void model_stats_rejected(struct model_stats *stats, uint32_t start);
+
+/** Account a sent message.
+ *
+ *  @param stats Statistics of the sending model.
+ *  @param start Cycle count before the message was passed to the stack.
+ *  @param err   Return value of bt_mesh_model_send().
+ */
+void model_stats_tx(struct model_stats *stats, uint32_t start, int err);
+
+/** Encoded length of the statistics of one model */
+#define MODEL_STATS_ENCODED_LEN 40
+
+/** Encode the statistics of one model, with times in microseconds.
+ *
+ *  The encoding is the rx, tx and failed send counts, followed by the last,
+ *  average and maximum handler time, the last, average and maximum send
+ *  time and the rejected count, all as 32-bit little endian values.
+ */
+void model_stats_encode(const struct model_stats *stats,
+			struct net_buf_simple *buf);
+
+#endif /* MODEL_STATS_H__ */
@@ -0,0 +1,119 @@
+/* msg_codec.h - Payload layouts of the access messages */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MSG_CODEC_H__
+#define MSG_CODEC_H__
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/mesh.h>
+
+/* Received messages are checked once against the payload lengths their
+ * layout allows, and then read in place through a packed struct instead of
+ * being pulled from the buffer field by field. Multi-byte fields are little
+ * endian on the air, and must be read through sys_le16_to_cpu() and
+ * sys_le32_to_cpu().
+ */
+
+/** Optional Transition Time and Delay fields of the Generic set messages */
+struct msg_transition {
+	uint8_t tt;
+	uint8_t delay;
+} __packed;
+
+struct msg_onoff_set {
+	uint8_t onoff;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+/* The target state and remaining time are only present during a
+ * transition
+ */
+struct msg_onoff_status {
+	uint8_t present;
+	uint8_t target;
+	uint8_t remaining;
+} __packed;
+
+struct msg_level_set {
+	int16_t level;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+struct msg_delta_set {
+	int32_t delta;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+struct msg_move_set {
+	int16_t delta;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+struct msg_lightness_set {
+	uint16_t lightness;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+struct msg_scene_recall {
+	uint16_t scene;
+	uint8_t tid;
+	struct msg_transition transition;
+} __packed;
+
+struct msg_scene_number {
+	uint16_t scene;
+} __packed;
+
+/** Entry of a vendor Batched Set message */
+struct msg_batch_entry {
+	uint16_t addr;
+	uint8_t onoff;
+} __packed;
+
+/** Payload lengths of a message with optional transition fields */
+#define MSG_LENS_TRANSITION(type)                                              \
+	(BIT(sizeof(type) - sizeof(struct msg_transition)) | BIT(sizeof(type)))
+
+/** Payload length of a message without optional fields */
+#define MSG_LENS_EXACT(type) BIT(sizeof(type))
+
+/** Get a view of a message payload.
+ *
+ *  The buffer isn't consumed.
+ *
+ *  @param buf  Message payload.
+ *  @param lens Bit mask of the valid payload lengths, see
+ *              MSG_LENS_TRANSITION() and MSG_LENS_EXACT().
+ *
+ *  @return Pointer to the payload, or NULL if its length isn't valid.
+ */
+static inline const void *msg_view(const struct net_buf_simple *buf,
+				   uint32_t lens)
+{
+	if (buf->len >= 32 || !(lens & BIT(buf->len))) {
+		return NULL;
+	}
+
+	return buf->data;
+}
+
+/** Get the optional transition fields of a set message view.
+ *
+ *  @param buf Message payload the view was taken from.
+ *  @param msg View of the message.
+ *
+ *  @return Pointer to the transition fields, or NULL if they're absent.
+ */
+#define MSG_TRANSITION(buf, msg)                                               \
+	((buf)->len == sizeof(*(msg)) ? &(msg)->transition : NULL)
+
+#endif /* MSG_CODEC_H__ */
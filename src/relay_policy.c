@@ -0,0 +1,250 @@
+/* relay_policy.c - Adaptive relay retransmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "app_state.h"
+#include "model_stats.h"
+#include "relay_policy.h"
+
+/* Flags the configured relay retransmit parameters in APP_STATE_RELAY_XMIT */
+#define RELAY_XMIT_SAVED BIT(8)
+
+/* Density counters at the end of the last window */
+static struct {
+	uint32_t pdus;
+	uint32_t dups;
+} last;
+
+static struct {
+	bool adaptive;
+	/* Relaying was disabled by the policy, not the Configuration Server */
+	bool suppressed;
+	/* Relay state and retransmit parameters last set by the policy */
+	enum bt_mesh_feat_state relay;
+	uint8_t xmit;
+	int64_t changed_at;
+	/* Results of the last window */
+	uint16_t density;
+	uint32_t pdus;
+	uint32_t dups;
+	uint32_t changes;
+} policy = {
+	.adaptive = true,
+	.changed_at = -(CONFIG_APP_RELAY_HOLD_S * MSEC_PER_SEC),
+};
+
+static struct k_work_q *eval_queue;
+static struct k_work_delayable eval_work;
+
+static void relay_update(enum bt_mesh_feat_state relay, uint8_t count,
+			 uint8_t xmit)
+{
+	int err;
+
+	xmit = BT_MESH_TRANSMIT(count, BT_MESH_TRANSMIT_INT(xmit));
+
+	/* The stack writes the relay state to flash */
+	err = bt_mesh_relay_set(relay, xmit);
+	if (err) {
+		printk("Relay update failed (err %d)\n", err);
+		return;
+	}
+
+	policy.relay = relay;
+	policy.xmit = xmit;
+	policy.changed_at = k_uptime_get();
+	policy.changes++;
+	policy.suppressed = relay == BT_MESH_FEATURE_DISABLED;
+	app_state_set(APP_STATE_RELAY_SUPPRESSED, policy.suppressed);
+
+	printk("Relay %s, %u retransmissions (density %u.%u)\n",
+	       policy.suppressed ? "disabled" : "enabled", count,
+	       policy.density / 10, policy.density % 10);
+}
+
+/** Forget the configured relay retransmit parameters, once the policy has
+ *  restored them or the Configuration Server has replaced them.
+ */
+static void relay_config_clear(void)
+{
+	policy.suppressed = false;
+	app_state_set(APP_STATE_RELAY_SUPPRESSED, false);
+	app_state_set(APP_STATE_RELAY_XMIT, 0);
+}
+
+/** Step the relay retransmit count down in dense neighbourhoods, and back up
+ *  to the count configured for the node in sparse ones. The configured
+ *  parameters, set through the Configuration Server or at build time, are
+ *  saved before the first step down. Relaying is only disabled once the
+ *  node no longer retransmits relayed PDUs, and only re-enabled if the
+ *  policy disabled it.
+ */
+static void relay_adapt(void)
+{
+	enum bt_mesh_feat_state relay = bt_mesh_relay_get();
+	uint8_t xmit = bt_mesh_relay_retransmit_get();
+	uint8_t count = BT_MESH_TRANSMIT_COUNT(xmit);
+	uint32_t config = app_state_get(APP_STATE_RELAY_XMIT);
+	bool saved = config & RELAY_XMIT_SAVED;
+	uint8_t config_xmit = saved ? config : xmit;
+
+	if (relay == BT_MESH_FEATURE_NOT_SUPPORTED) {
+		return;
+	}
+
+	/* The Configuration Server changed the relay state since the policy
+	 * last did, so its settings are the ones to restore to from now on.
+	 */
+	if (saved && (relay != policy.relay || xmit != policy.xmit)) {
+		relay_config_clear();
+		saved = false;
+		config_xmit = xmit;
+	}
+
+	if (relay == BT_MESH_FEATURE_DISABLED && !policy.suppressed) {
+		return;
+	}
+
+	/* Every change is written to flash by the stack */
+	if (k_uptime_get() - policy.changed_at <
+	    CONFIG_APP_RELAY_HOLD_S * MSEC_PER_SEC) {
+		return;
+	}
+
+	if (policy.density >= CONFIG_APP_RELAY_DENSITY_HIGH) {
+		if (relay != BT_MESH_FEATURE_ENABLED) {
+			return;
+		}
+
+		if (!saved) {
+			app_state_set(APP_STATE_RELAY_XMIT,
+				      RELAY_XMIT_SAVED | xmit);
+		}
+
+		if (count > 0) {
+			relay_update(BT_MESH_FEATURE_ENABLED, count - 1, xmit);
+		} else {
+			relay_update(BT_MESH_FEATURE_DISABLED, 0, xmit);
+		}
+	} else if (policy.density <= CONFIG_APP_RELAY_DENSITY_LOW) {
+		if (relay == BT_MESH_FEATURE_DISABLED) {
+			relay_update(BT_MESH_FEATURE_ENABLED, 0, config_xmit);
+		} else if (saved &&
+			   count < BT_MESH_TRANSMIT_COUNT(config_xmit)) {
+			relay_update(BT_MESH_FEATURE_ENABLED, count + 1,
+				     config_xmit);
+		}
+
+		if (saved && policy.relay == BT_MESH_FEATURE_ENABLED &&
+		    policy.xmit == config_xmit) {
+			relay_config_clear();
+		}
+	}
+}
+
+static void relay_policy_eval(struct k_work *work)
+{
+	uint32_t pdus = (uint32_t)atomic_get(&density_stats.pdus) - last.pdus;
+	uint32_t dups = (uint32_t)atomic_get(&density_stats.dups) - last.dups;
+
+	last.pdus += pdus;
+	last.dups += dups;
+
+	/* Relays only change the TTL of the PDUs they forward, so the
+	 * neighbours relaying the same copy of a message send identical PDUs,
+	 * which show up as duplicates. Copies of a PDU first heard in the
+	 * previous window only count as duplicates.
+	 */
+	policy.pdus = pdus;
+	policy.dups = dups;
+	policy.density = pdus ? pdus * 10 / MAX(pdus - dups, 1) : 0;
+
+	if (policy.adaptive && bt_mesh_is_provisioned() &&
+	    pdus >= CONFIG_APP_RELAY_MIN_PDUS) {
+		relay_adapt();
+	}
+
+	k_work_schedule_for_queue(eval_queue, &eval_work,
+				  K_MSEC(CONFIG_APP_RELAY_WINDOW_MS));
+}
+
+void relay_policy_encode(struct net_buf_simple *buf)
+{
+	net_buf_simple_add_u8(buf, policy.adaptive);
+	net_buf_simple_add_u8(buf, bt_mesh_relay_get());
+	net_buf_simple_add_u8(buf, bt_mesh_relay_retransmit_get());
+	net_buf_simple_add_le16(buf, policy.density);
+	net_buf_simple_add_le32(buf, policy.pdus);
+	net_buf_simple_add_le32(buf, policy.dups);
+	net_buf_simple_add_le32(buf, policy.changes);
+}
+
+int relay_policy_init(struct k_work_q *queue)
+{
+	policy.suppressed = app_state_get(APP_STATE_RELAY_SUPPRESSED);
+
+	/* The stack restored the relay state the policy set before the
+	 * reboot
+	 */
+	policy.relay = bt_mesh_relay_get();
+	policy.xmit = bt_mesh_relay_retransmit_get();
+
+	eval_queue = queue;
+	k_work_init_delayable(&eval_work, relay_policy_eval);
+
+	k_work_schedule_for_queue(eval_queue, &eval_work,
+				  K_MSEC(CONFIG_APP_RELAY_WINDOW_MS));
+
+	return 0;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_relay_status(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t xmit = bt_mesh_relay_retransmit_get();
+
+	shell_print(sh, "policy:  %s", policy.adaptive ? "adaptive" : "off");
+	shell_print(sh, "relay:   %s, %u retransmissions every %u ms",
+		    bt_mesh_relay_get() == BT_MESH_FEATURE_ENABLED ?
+		    "enabled" : "disabled", BT_MESH_TRANSMIT_COUNT(xmit),
+		    BT_MESH_TRANSMIT_INT(xmit));
+	shell_print(sh, "density: %u.%u copies per PDU (%u PDUs, "
+		    "%u duplicates)", policy.density / 10,
+		    policy.density % 10, policy.pdus, policy.dups);
+	shell_print(sh, "changes: %u", policy.changes);
+
+	return 0;
+}
+
+static int cmd_relay_auto(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = 0;
+	bool adaptive = shell_strtobool(argv[1], 0, &err);
+
+	if (err) {
+		shell_error(sh, "Expected on or off");
+		return err;
+	}
+
+	policy.adaptive = adaptive;
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(relay_cmds,
+	SHELL_CMD(status, NULL, "Print relay state and neighbour density",
+		  cmd_relay_status),
+	SHELL_CMD_ARG(auto, NULL, "Adapt relaying to density <on|off>",
+		      cmd_relay_auto, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(relay, &relay_cmds, "Adaptive relay policy", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,40 @@
+/* relay_policy.h - Adaptive relay retransmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RELAY_POLICY_H__
+#define RELAY_POLICY_H__
+
+#include <zephyr/kernel.h>
+
+struct net_buf_simple;
+
+/** Length of the encoded relay policy status */
+#define RELAY_POLICY_ENCODED_LEN 17
+
+/** Start measuring the neighbour density and adapting the relay state.
+ *
+ *  Must be called after the settings have been loaded, so the relay state
+ *  configured for the node is known.
+ *
+ *  @param queue Work queue the density is evaluated on.
+ *
+ *  @return 0 on success, or (negative) error code otherwise.
+ */
+int relay_policy_init(struct k_work_q *queue);
+
+/** Encode the relay policy status for a vendor Relay Status message.
+ *
+ *  Encodes whether the policy is active, the relay state and retransmit
+ *  parameters, the density measured in the last window in tenths of copies
+ *  per network PDU, the PDUs and duplicates heard in that window and the
+ *  number of relay state changes made by the policy, in
+ *  RELAY_POLICY_ENCODED_LEN bytes.
+ *
+ *  @param buf Buffer to add the status to.
+ */
+void relay_policy_encode(struct net_buf_simple *buf);
+
+#endif /* RELAY_POLICY_H__ */
@@ -0,0 +1,192 @@
+/* scene.c - Scene register */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/printk.h>
+
+#include "model_stats.h"
+#include "scene.h"
+
+#define SCENE_SETTINGS_KEY "app/scene"
+
+struct scene {
+	/* 0 for an empty register entry */
+	uint16_t number;
+	uint16_t lightness;
+};
+
+static struct scene scenes[CONFIG_APP_SCENE_COUNT];
+static struct scene current;
+static K_MUTEX_DEFINE(scene_lock);
+
+static struct scene *scene_find(uint16_t number)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(scenes); i++) {
+		if (scenes[i].number == number) {
+			return &scenes[i];
+		}
+	}
+
+	return NULL;
+}
+
+/** Write the register to persistent storage, outside of the lock so the
+ *  message handlers aren't held up by the flash.
+ */
+static void scene_save(struct k_work *work)
+{
+	struct scene copy[ARRAY_SIZE(scenes)];
+	int err;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+	memcpy(copy, scenes, sizeof(copy));
+	k_mutex_unlock(&scene_lock);
+
+	err = settings_save_one(SCENE_SETTINGS_KEY, copy, sizeof(copy));
+	if (err) {
+		atomic_inc(&flash_stats.failed);
+		printk("Storing scenes failed (err %d)\n", err);
+		return;
+	}
+
+	atomic_inc(&flash_stats.writes);
+	atomic_add(&flash_stats.bytes, sizeof(copy));
+}
+
+static K_WORK_DELAYABLE_DEFINE(save_work, scene_save);
+
+/** Schedule a write of the register. Changes made before it runs are
+ *  written together.
+ */
+static void scene_save_schedule(void)
+{
+	if (!IS_ENABLED(CONFIG_SETTINGS)) {
+		return;
+	}
+
+	atomic_inc(&flash_stats.changes);
+	k_work_schedule(&save_work, K_MSEC(CONFIG_APP_STATE_SAVE_DELAY_MS));
+}
+
+enum scene_status scene_store(uint16_t number, uint16_t lightness)
+{
+	struct scene *scene;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+
+	scene = scene_find(number);
+	if (!scene) {
+		scene = scene_find(0);
+	}
+
+	if (!scene) {
+		k_mutex_unlock(&scene_lock);
+		return SCENE_REG_FULL;
+	}
+
+	scene->number = number;
+	scene->lightness = lightness;
+	current = *scene;
+
+	scene_save_schedule();
+
+	k_mutex_unlock(&scene_lock);
+
+	return SCENE_SUCCESS;
+}
+
+enum scene_status scene_delete(uint16_t number)
+{
+	struct scene *scene;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+
+	scene = scene_find(number);
+	if (scene) {
+		scene->number = 0;
+		scene_save_schedule();
+	}
+
+	if (current.number == number) {
+		current.number = 0;
+	}
+
+	k_mutex_unlock(&scene_lock);
+
+	return SCENE_SUCCESS;
+}
+
+enum scene_status scene_recall(uint16_t number, uint16_t *lightness)
+{
+	struct scene *scene;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+
+	scene = scene_find(number);
+	if (scene) {
+		current = *scene;
+		*lightness = scene->lightness;
+	}
+
+	k_mutex_unlock(&scene_lock);
+
+	return scene ? SCENE_SUCCESS : SCENE_NOT_FOUND;
+}
+
+uint16_t scene_current(uint16_t lightness)
+{
+	uint16_t number;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+
+	/* Any change to the light since the scene was stored or recalled
+	 * invalidates it.
+	 */
+	number = current.lightness == lightness ? current.number : 0;
+
+	k_mutex_unlock(&scene_lock);
+
+	return number;
+}
+
+size_t scene_list(uint16_t *numbers, size_t max)
+{
+	size_t count = 0;
+
+	k_mutex_lock(&scene_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(scenes) && count < max; i++) {
+		if (scenes[i].number) {
+			numbers[count++] = scenes[i].number;
+		}
+	}
+
+	k_mutex_unlock(&scene_lock);
+
+	return count;
+}
+
+static __maybe_unused int scene_settings_set(const char *name, size_t len,
+					     settings_read_cb read_cb,
+					     void *cb_arg)
+{
+	ssize_t read;
+
+	if ((name && *name) || len != sizeof(scenes)) {
+		return -ENOENT;
+	}
+
+	read = read_cb(cb_arg, scenes, sizeof(scenes));
+
+	return read < 0 ? read : 0;
+}
+
+#if defined(CONFIG_SETTINGS)
+SETTINGS_STATIC_HANDLER_DEFINE(app_scene, SCENE_SETTINGS_KEY, NULL,
+			       scene_settings_set, NULL, NULL);
+#endif
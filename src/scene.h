@@ -0,0 +1,70 @@
+/* scene.h - Scene register */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCENE_H__
+#define SCENE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Scene status codes, as sent in Scene Status messages */
+enum scene_status {
+	SCENE_SUCCESS = 0x00,
+	SCENE_REG_FULL = 0x01,
+	SCENE_NOT_FOUND = 0x02,
+};
+
+/** Store a lightness in a scene, replacing the scene if it exists.
+ *
+ *  The register is written to persistent storage
+ *  CONFIG_APP_STATE_SAVE_DELAY_MS later, along with any other change made in
+ *  the meantime.
+ *
+ *  @param number    Scene number, not 0.
+ *  @param lightness Lightness to store.
+ *
+ *  @return Scene status code.
+ */
+enum scene_status scene_store(uint16_t number, uint16_t lightness);
+
+/** Delete a scene. Deleting a scene that doesn't exist succeeds.
+ *
+ *  @param number Scene number.
+ *
+ *  @return Scene status code.
+ */
+enum scene_status scene_delete(uint16_t number);
+
+/** Look up a scene and make it the current scene.
+ *
+ *  @param number    Scene number.
+ *  @param lightness Lightness stored in the scene.
+ *
+ *  @return Scene status code.
+ */
+enum scene_status scene_recall(uint16_t number, uint16_t *lightness);
+
+/** Get the current scene.
+ *
+ *  The current scene is the last scene stored or recalled, as long as the
+ *  light hasn't been changed since.
+ *
+ *  @param lightness Target lightness of the light.
+ *
+ *  @return Current scene number, or 0 if there is none.
+ */
+uint16_t scene_current(uint16_t lightness);
+
+/** Get the numbers of all stored scenes.
+ *
+ *  @param numbers Array to fill in.
+ *  @param max     Size of the array.
+ *
+ *  @return Number of scenes written to the array.
+ */
+size_t scene_list(uint16_t *numbers, size_t max);
+
+#endif /* SCENE_H__ */
@@ -0,0 +1,465 @@
+/* sub_table.c - Group subscription table */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "model_stats.h"
+#include "sub_table.h"
+
+#define SUB_SETTINGS_KEY "app/sub"
+
+#define SLOT_COUNT(table) BIT((table)->bits)
+
+/* Rehash once a quarter of the slots are tombstones, so misses don't have
+ * to probe through most of the table.
+ */
+#define DELETED_MAX(table) (SLOT_COUNT(table) / 4)
+
+/* Neither can be a subscription: 0x0000 is the unassigned address, and
+ * fixed group addresses are always accepted by the stack.
+ */
+#define SLOT_EMPTY   BT_MESH_ADDR_UNASSIGNED
+#define SLOT_DELETED BT_MESH_ADDR_ALL_NODES
+
+SUB_TABLE_DEFINE(onoff_subs, CONFIG_APP_SUB_MAX);
+
+static uint32_t slot_hash(struct sub_table *table, uint16_t addr)
+{
+	/* Fibonacci hashing, keeping the top bits of the product */
+	return ((uint32_t)addr * 2654435769u) >> (32 - table->bits);
+}
+
+/** Find the slot holding @p addr, or the slot it should be inserted in. */
+static uint16_t *slot_find(struct sub_table *table, uint16_t addr,
+			   bool insert)
+{
+	uint32_t mask = SLOT_COUNT(table) - 1;
+	uint16_t *free_slot = NULL;
+	uint32_t i = slot_hash(table, addr);
+
+	for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		uint16_t *slot = &table->slots[i];
+
+		if (*slot == addr) {
+			return slot;
+		}
+
+		if (*slot == SLOT_DELETED) {
+			if (!free_slot) {
+				free_slot = slot;
+			}
+
+			continue;
+		}
+
+		if (*slot == SLOT_EMPTY) {
+			return insert ? (free_slot ? free_slot : slot) : NULL;
+		}
+	}
+
+	return insert ? free_slot : NULL;
+}
+
+/** Insert the remaining addresses again into a table without tombstones.
+ *  Takes time linear in the table size, so only runs every DELETED_MAX
+ *  removals.
+ */
+static void sub_table_rehash(struct sub_table *table)
+{
+	uint16_t addrs[CONFIG_APP_SUB_MAX];
+	size_t count = 0;
+
+	for (size_t i = 0; i < SLOT_COUNT(table); i++) {
+		uint16_t addr = table->slots[i];
+
+		if (addr != SLOT_EMPTY && addr != SLOT_DELETED) {
+			addrs[count++] = addr;
+		}
+	}
+
+	memset(table->slots, 0, SLOT_COUNT(table) * sizeof(table->slots[0]));
+	table->deleted = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		*slot_find(table, addrs[i], true) = addrs[i];
+	}
+}
+
+static bool sub_addr_valid(uint16_t addr)
+{
+	return BT_MESH_ADDR_IS_VIRTUAL(addr) ||
+	       (BT_MESH_ADDR_IS_GROUP(addr) &&
+		!BT_MESH_ADDR_IS_FIXED_GROUP(addr));
+}
+
+int sub_table_add(struct sub_table *table, uint16_t addr)
+{
+	k_spinlock_key_t key;
+	uint16_t *slot;
+	int err = 0;
+
+	if (!sub_addr_valid(addr)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&table->lock);
+
+	slot = slot_find(table, addr, true);
+	if (!slot || (*slot != addr && table->count == table->max)) {
+		err = -ENOMEM;
+	} else if (*slot != addr) {
+		if (*slot == SLOT_DELETED) {
+			table->deleted--;
+		}
+
+		*slot = addr;
+		table->count++;
+	}
+
+	k_spin_unlock(&table->lock, key);
+
+	return err;
+}
+
+int sub_table_del(struct sub_table *table, uint16_t addr)
+{
+	k_spinlock_key_t key;
+	uint16_t *slot;
+
+	if (!sub_addr_valid(addr)) {
+		return -ENOENT;
+	}
+
+	key = k_spin_lock(&table->lock);
+
+	slot = slot_find(table, addr, false);
+	if (slot) {
+		*slot = SLOT_DELETED;
+		table->count--;
+
+		if (++table->deleted > DELETED_MAX(table)) {
+			sub_table_rehash(table);
+		}
+	}
+
+	k_spin_unlock(&table->lock, key);
+
+	return slot ? 0 : -ENOENT;
+}
+
+bool sub_table_has(struct sub_table *table, uint16_t addr)
+{
+	k_spinlock_key_t key;
+	bool found;
+
+	if (!sub_addr_valid(addr)) {
+		return false;
+	}
+
+	key = k_spin_lock(&table->lock);
+	found = slot_find(table, addr, false) != NULL;
+	k_spin_unlock(&table->lock, key);
+
+	return found;
+}
+
+size_t sub_table_list(struct sub_table *table, uint16_t *addrs, size_t max)
+{
+	k_spinlock_key_t key;
+	size_t count = 0;
+
+	key = k_spin_lock(&table->lock);
+
+	for (size_t i = 0; i < SLOT_COUNT(table) && count < max; i++) {
+		uint16_t addr = table->slots[i];
+
+		if (addr != SLOT_EMPTY && addr != SLOT_DELETED) {
+			addrs[count++] = addr;
+		}
+	}
+
+	k_spin_unlock(&table->lock, key);
+
+	return count;
+}
+
+int sub_table_set(struct sub_table *table, const uint16_t *addrs,
+		  size_t count)
+{
+	k_spinlock_key_t key;
+	int err = 0;
+
+	key = k_spin_lock(&table->lock);
+
+	memset(table->slots, 0, SLOT_COUNT(table) * sizeof(table->slots[0]));
+	table->count = 0;
+	table->deleted = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		uint16_t *slot;
+
+		if (!sub_addr_valid(addrs[i])) {
+			continue;
+		}
+
+		slot = slot_find(table, addrs[i], true);
+		if (*slot == addrs[i]) {
+			continue;
+		}
+
+		if (table->count == table->max) {
+			err = -ENOMEM;
+			break;
+		}
+
+		*slot = addrs[i];
+		table->count++;
+	}
+
+	k_spin_unlock(&table->lock, key);
+
+	return err;
+}
+
+/** Write the OnOff Server subscriptions to persistent storage. */
+static void onoff_subs_save(struct k_work *work)
+{
+	uint16_t addrs[CONFIG_APP_SUB_MAX];
+	size_t count;
+	int err;
+
+	count = sub_table_list(&onoff_subs, addrs, ARRAY_SIZE(addrs));
+
+	for (size_t i = 0; i < count; i++) {
+		addrs[i] = sys_cpu_to_le16(addrs[i]);
+	}
+
+	/* An empty value deletes the entry */
+	err = settings_save_one(SUB_SETTINGS_KEY, addrs,
+				count * sizeof(addrs[0]));
+	if (err) {
+		atomic_inc(&flash_stats.failed);
+		printk("Storing subscriptions failed (err %d)\n", err);
+		return;
+	}
+
+	atomic_inc(&flash_stats.writes);
+	atomic_add(&flash_stats.bytes, count * sizeof(addrs[0]));
+}
+
+static K_WORK_DELAYABLE_DEFINE(save_work, onoff_subs_save);
+
+static void onoff_subs_save_schedule(void)
+{
+	if (!IS_ENABLED(CONFIG_SETTINGS)) {
+		return;
+	}
+
+	atomic_inc(&flash_stats.changes);
+	k_work_schedule(&save_work, K_MSEC(CONFIG_APP_STATE_SAVE_DELAY_MS));
+}
+
+int onoff_subs_add(uint16_t addr)
+{
+	int err;
+
+	if (sub_table_has(&onoff_subs, addr)) {
+		return 0;
+	}
+
+	err = sub_table_add(&onoff_subs, addr);
+	if (err) {
+		return err;
+	}
+
+	onoff_subs_save_schedule();
+
+	return 0;
+}
+
+int onoff_subs_del(uint16_t addr)
+{
+	int err;
+
+	err = sub_table_del(&onoff_subs, addr);
+	if (err) {
+		return err;
+	}
+
+	onoff_subs_save_schedule();
+
+	return 0;
+}
+
+static __maybe_unused int onoff_subs_settings_set(const char *name, size_t len,
+						  settings_read_cb read_cb,
+						  void *cb_arg)
+{
+	uint16_t addrs[CONFIG_APP_SUB_MAX];
+	ssize_t read;
+
+	if ((name && *name) || len % sizeof(addrs[0]) || len > sizeof(addrs)) {
+		return -ENOENT;
+	}
+
+	read = read_cb(cb_arg, addrs, len);
+	if (read < 0) {
+		return read;
+	}
+
+	for (size_t i = 0; i < read / sizeof(addrs[0]); i++) {
+		(void)sub_table_add(&onoff_subs, sys_le16_to_cpu(addrs[i]));
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_SETTINGS)
+SETTINGS_STATIC_HANDLER_DEFINE(app_sub, SUB_SETTINGS_KEY, NULL,
+			       onoff_subs_settings_set, NULL, NULL);
+#endif
+
+#if defined(CONFIG_SHELL)
+static int cmd_sub_add(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = 0;
+	uint16_t addr = shell_strtoul(argv[1], 16, &err);
+
+	if (!err) {
+		err = onoff_subs_add(addr);
+	}
+
+	if (err) {
+		shell_error(sh, "Failed to add 0x%04x (err %d)", addr, err);
+	}
+
+	return err;
+}
+
+static int cmd_sub_del(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = 0;
+	uint16_t addr = shell_strtoul(argv[1], 16, &err);
+
+	if (!err) {
+		err = onoff_subs_del(addr);
+	}
+
+	if (err) {
+		shell_error(sh, "Failed to remove 0x%04x (err %d)", addr, err);
+	}
+
+	return err;
+}
+
+static int cmd_sub_list(const struct shell *sh, size_t argc, char **argv)
+{
+	uint16_t addrs[CONFIG_APP_SUB_MAX];
+	size_t count;
+
+	count = sub_table_list(&onoff_subs, addrs, ARRAY_SIZE(addrs));
+
+	for (size_t i = 0; i < count; i++) {
+		shell_print(sh, "0x%04x", addrs[i]);
+	}
+
+	shell_print(sh, "%u of %u groups", (uint32_t)count, CONFIG_APP_SUB_MAX);
+
+	return 0;
+}
+
+#define BENCH_LOOKUPS 1000
+
+SUB_TABLE_DEFINE(bench_subs, CONFIG_APP_SUB_MAX);
+
+static bool linear_has(const uint16_t *addrs, size_t count, uint16_t addr)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (addrs[i] == addr) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/** Compare the cost of a lookup in the hash table with a linear scan, like
+ *  the one the stack does over its subscription lists.
+ */
+static int cmd_sub_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	static const size_t counts[] = { 2, 16, 64 };
+	static uint16_t addrs[64];
+	static uint16_t lookups[BENCH_LOOKUPS];
+
+	shell_print(sh, "%6s %12s %12s", "groups", "hash ns", "linear ns");
+
+	for (size_t c = 0; c < ARRAY_SIZE(counts); c++) {
+		size_t count = MIN(counts[c], CONFIG_APP_SUB_MAX);
+		volatile size_t hits = 0;
+		uint32_t start;
+		uint64_t hash_cyc;
+		uint64_t linear_cyc;
+		uint32_t hash_ns;
+		uint32_t linear_ns;
+
+		for (size_t i = 0; i < count; i++) {
+			addrs[i] = 0xc000 + i * 7;
+		}
+
+		(void)sub_table_set(&bench_subs, addrs, count);
+
+		/* Half of the lookups hit, half miss */
+		for (size_t i = 0; i < ARRAY_SIZE(lookups); i++) {
+			uint32_t rnd = sys_rand32_get();
+
+			lookups[i] = (i & 1) ? addrs[rnd % count] :
+					       0xd000 + (rnd & 0xfff);
+		}
+
+		start = k_cycle_get_32();
+		for (size_t i = 0; i < ARRAY_SIZE(lookups); i++) {
+			hits += sub_table_has(&bench_subs, lookups[i]);
+		}
+		hash_cyc = k_cycle_get_32() - start;
+
+		start = k_cycle_get_32();
+		for (size_t i = 0; i < ARRAY_SIZE(lookups); i++) {
+			hits += linear_has(addrs, count, lookups[i]);
+		}
+		linear_cyc = k_cycle_get_32() - start;
+
+		hash_ns = k_cyc_to_ns_floor64(hash_cyc) / BENCH_LOOKUPS;
+		linear_ns = k_cyc_to_ns_floor64(linear_cyc) / BENCH_LOOKUPS;
+
+		shell_print(sh, "%6u %12u %12u", (uint32_t)count, hash_ns,
+			    linear_ns);
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_cmds,
+	SHELL_CMD_ARG(add, NULL, "Subscribe to a group <addr>", cmd_sub_add,
+		      2, 0),
+	SHELL_CMD_ARG(del, NULL, "Unsubscribe from a group <addr>",
+		      cmd_sub_del, 2, 0),
+	SHELL_CMD(list, NULL, "List subscribed groups", cmd_sub_list),
+	SHELL_CMD(bench, NULL, "Compare hashed and linear lookup cost",
+		  cmd_sub_bench),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(sub, &sub_cmds, "Generic OnOff Server group subscriptions",
+		   NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,118 @@
+/* sub_table.h - Group subscription table */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SUB_TABLE_H__
+#define SUB_TABLE_H__
+
+#include <zephyr/kernel.h>
+
+/* Twice the maximum number of groups, so the table is at most half full */
+#define SUB_TABLE_SLOTS(max) BIT(LOG2CEIL(max) + 1)
+
+/** Set of group and virtual addresses, stored in an open addressing hash
+ *  table with linear probing, so lookups take constant time regardless of
+ *  the number of subscriptions.
+ */
+struct sub_table {
+	uint16_t *slots;
+	/* log2 of the number of slots */
+	uint8_t bits;
+	uint16_t max;
+	size_t count;
+	/* Slots of removed addresses, which lookups have to probe past */
+	size_t deleted;
+	struct k_spinlock lock;
+};
+
+/** Define a subscription table holding up to @p _max addresses, at most
+ *  CONFIG_APP_SUB_MAX.
+ */
+#define SUB_TABLE_DEFINE(_name, _max)                                          \
+	BUILD_ASSERT((_max) > 0 && (_max) <= CONFIG_APP_SUB_MAX);              \
+	static uint16_t _name##_slots[SUB_TABLE_SLOTS(_max)];                  \
+	struct sub_table _name = {                                             \
+		.slots = _name##_slots,                                        \
+		.bits = LOG2CEIL(_max) + 1,                                    \
+		.max = (_max),                                                 \
+	}
+
+/** Application level subscriptions of the Generic OnOff Server */
+extern struct sub_table onoff_subs;
+
+/** Add an address to the table.
+ *
+ *  @param table Subscription table.
+ *  @param addr  Group or virtual address.
+ *
+ *  @return 0 on success, -EINVAL if @p addr isn't a group or virtual
+ *          address, or -ENOMEM if the table is full.
+ */
+int sub_table_add(struct sub_table *table, uint16_t addr);
+
+/** Remove an address from the table.
+ *
+ *  @param table Subscription table.
+ *  @param addr  Address to remove.
+ *
+ *  @return 0 on success, or -ENOENT if the address isn't in the table.
+ */
+int sub_table_del(struct sub_table *table, uint16_t addr);
+
+/** Check whether an address is in the table.
+ *
+ *  Safe to call from any context, including the Bluetooth RX thread.
+ *
+ *  @param table Subscription table.
+ *  @param addr  Address to look up.
+ */
+bool sub_table_has(struct sub_table *table, uint16_t addr);
+
+/** Get the addresses in the table.
+ *
+ *  @param table Subscription table.
+ *  @param addrs Array to fill in.
+ *  @param max   Size of the array.
+ *
+ *  @return Number of addresses written to the array.
+ */
+size_t sub_table_list(struct sub_table *table, uint16_t *addrs, size_t max);
+
+/** Replace the contents of the table.
+ *
+ *  Lookups made meanwhile from other threads see either the old or the
+ *  new contents. Unassigned and fixed group addresses are skipped, so a
+ *  subscription list from the stack can be passed as is.
+ *
+ *  @param table Subscription table.
+ *  @param addrs Addresses to store.
+ *  @param count Number of addresses.
+ *
+ *  @return 0 on success, or -ENOMEM if only some of the addresses fit.
+ */
+int sub_table_set(struct sub_table *table, const uint16_t *addrs,
+		  size_t count);
+
+/** Subscribe the OnOff Server to a group.
+ *
+ *  The subscriptions are written to persistent storage
+ *  CONFIG_APP_STATE_SAVE_DELAY_MS later, along with any other change made in
+ *  the meantime.
+ *
+ *  @param addr Group or virtual address.
+ *
+ *  @return 0 on success, or a negative error code from sub_table_add().
+ */
+int onoff_subs_add(uint16_t addr);
+
+/** Unsubscribe the OnOff Server from a group.
+ *
+ *  @param addr Group or virtual address.
+ *
+ *  @return 0 on success, or -ENOENT if it wasn't subscribed.
+ */
+int onoff_subs_del(uint16_t addr);
+
+#endif /* SUB_TABLE_H__ */
@@ -0,0 +1,79 @@
+/* tid_cache.c - Recent transactions of the Generic OnOff Server */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+
+#include "model_stats.h"
+#include "tid_cache.h"
+
+struct tid_entry {
+	/* Source of the transaction, unassigned if the entry is unused */
+	uint16_t src;
+	uint16_t dst;
+	uint8_t tid;
+	/* Uptime of the last message of the transaction */
+	int64_t time;
+};
+
+static struct tid_entry entries[CONFIG_APP_TID_CACHE_SIZE];
+static struct k_spinlock lock;
+
+/** Find the entry of @p src, or the one to replace with it: an unused
+ *  entry, or the least recently used one.
+ */
+static struct tid_entry *tid_entry_find(uint16_t src)
+{
+	struct tid_entry *free_entry = NULL;
+	struct tid_entry *oldest = &entries[0];
+
+	for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+		if (entries[i].src == src) {
+			return &entries[i];
+		}
+
+		if (entries[i].src == BT_MESH_ADDR_UNASSIGNED) {
+			if (!free_entry) {
+				free_entry = &entries[i];
+			}
+		} else if (entries[i].time < oldest->time) {
+			oldest = &entries[i];
+		}
+	}
+
+	return free_entry ? free_entry : oldest;
+}
+
+bool tid_cache_replay(uint16_t src, uint16_t dst, uint8_t tid)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct tid_entry *entry = tid_entry_find(src);
+	int64_t now = k_uptime_get();
+	bool replay;
+
+	if (entry->src != src) {
+		if (entry->src != BT_MESH_ADDR_UNASSIGNED &&
+		    now - entry->time < TID_CACHE_WINDOW_MS) {
+			atomic_inc(&tid_stats.evictions);
+		}
+
+		entry->src = src;
+		replay = false;
+	} else {
+		replay = entry->dst == dst && entry->tid == tid &&
+			 now - entry->time < TID_CACHE_WINDOW_MS;
+	}
+
+	entry->dst = dst;
+	entry->tid = tid;
+	entry->time = now;
+
+	k_spin_unlock(&lock, key);
+
+	atomic_inc(replay ? &tid_stats.replays : &tid_stats.transactions);
+
+	return replay;
+}
@@ -0,0 +1,33 @@
+/* tid_cache.h - Recent transactions of the Generic OnOff Server */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TID_CACHE_H__
+#define TID_CACHE_H__
+
+#include <zephyr/kernel.h>
+
+/* Messages with the same source, destination and TID as the previous one
+ * from the same source are part of the same transaction if they arrive
+ * within this time of it (Mesh Model specification, section 3.3.2.2.3).
+ */
+#define TID_CACHE_WINDOW_MS (6 * MSEC_PER_SEC)
+
+/** Check whether a message starts a new transaction, and record it.
+ *
+ *  The last transaction of up to CONFIG_APP_TID_CACHE_SIZE sources is
+ *  remembered. Safe to call from any context, including the Bluetooth RX
+ *  thread.
+ *
+ *  @param src Source address of the message.
+ *  @param dst Destination address of the message.
+ *  @param tid Transaction identifier of the message.
+ *
+ *  @return true if the message is a retransmission of the previous
+ *          transaction from @p src, false if it starts a new one.
+ */
+bool tid_cache_replay(uint16_t src, uint16_t dst, uint8_t tid);
+
+#endif /* TID_CACHE_H__ */